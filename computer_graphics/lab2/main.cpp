@@ -37,12 +37,13 @@ public:
                 pixels[y * width + x] = color;
             } else {
                 COLOR dest = pixels[y * width + x];
-                float alpha = color.a / 255.0f;
-                float inv_alpha = 1.0f - alpha;
+                int alpha = color.a;
+                int inv_alpha = 255 - alpha;
+                // Целочисленное смешивание: (v + 128) * 257 >> 16 ~ v / 255 с округлением
                 pixels[y * width + x] = {
-                    static_cast<Uint8>(color.r * alpha + dest.r * inv_alpha),
-                    static_cast<Uint8>(color.g * alpha + dest.g * inv_alpha),
-                    static_cast<Uint8>(color.b * alpha + dest.b * inv_alpha),
+                    static_cast<Uint8>(((color.r * alpha + dest.r * inv_alpha + 128) * 257) >> 16),
+                    static_cast<Uint8>(((color.g * alpha + dest.g * inv_alpha + 128) * 257) >> 16),
+                    static_cast<Uint8>(((color.b * alpha + dest.b * inv_alpha + 128) * 257) >> 16),
                     255
                 };
             }
@@ -3,14 +3,33 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
+#include <cstring>
 #include <tuple>
 #include <memory>
+#include <unordered_map>
+#include <initializer_list>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOFTWARE2D_X86_SIMD
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -77,6 +96,15 @@ public:
         updateCameraVectors();
     }
 
+    // Программное положение камеры (путь бенчмарка)
+    void LookAt(const glm::vec3& position, const glm::vec3& target) {
+        glm::vec3 direction = glm::normalize(target - position);
+        Position = position;
+        Yaw = glm::degrees(atan2f(direction.z, direction.x));
+        Pitch = glm::degrees(asinf(direction.y));
+        updateCameraVectors();
+    }
+
     void ProcessMouseScroll(float yoffset) {
         Zoom -= yoffset;
         if (Zoom < 1.0f) Zoom = 1.0f;
@@ -97,6 +125,11 @@ private:
 
 class Shader {
 public:
+    // Интернированное имя uniform-переменной: индекс в общей для всех программ таблице имён
+    struct Handle {
+        int slot;
+    };
+
     unsigned int ID;
 
     Shader(const char* vertexPath, const char* fragmentPath, bool isFile = false) {
@@ -124,45 +157,77 @@ public:
 
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        collectActiveUniforms();
     }
 
     void use() { glUseProgram(ID); }
 
+    // Регистрирует имя один раз; дальше сеттеры работают по индексу без строк и запросов к драйверу
+    static Handle handle(const std::string &name) {
+        auto it = handleSlots().find(name);
+        if (it != handleSlots().end()) return Handle{it->second};
+        int slot = (int)handleNames().size();
+        handleNames().push_back(name);
+        handleSlots().emplace(name, slot);
+        return Handle{slot};
+    }
+
+    void bindUniformBlock(const std::string &blockName, GLuint binding) const {
+        GLuint index = glGetUniformBlockIndex(ID, blockName.c_str());
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(ID, index, binding);
+    }
+
+    GLint location(Handle h) const {
+        if (h.slot >= (int)locations.size()) resolveHandles();
+        return locations[h.slot];
+    }
+    GLint location(const std::string &name) const { return location(handle(name)); }
+
+    void setBool(Handle h, bool value) const { glUniform1i(location(h), (int)value); }
+    void setInt(Handle h, int value) const { glUniform1i(location(h), value); }
+    void setFloat(Handle h, float value) const { glUniform1f(location(h), value); }
+    void setVec2(Handle h, const glm::vec2 &value) const { glUniform2fv(location(h), 1, &value[0]); }
+    void setVec3(Handle h, const glm::vec3 &value) const { glUniform3fv(location(h), 1, &value[0]); }
+    void setVec4(Handle h, const glm::vec4 &value) const { glUniform4fv(location(h), 1, &value[0]); }
+    void setMat3(Handle h, const glm::mat3 &mat) const { glUniformMatrix3fv(location(h), 1, GL_FALSE, &mat[0][0]); }
+    void setMat4(Handle h, const glm::mat4 &mat) const { glUniformMatrix4fv(location(h), 1, GL_FALSE, &mat[0][0]); }
+
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     void setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
     }
     void setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
     }
     void setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     void setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     void setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
@@ -205,6 +270,57 @@ private:
             }
         }
     }
+
+    // Один проход интроспекции после линковки вместо glGetUniformLocation на каждый set-вызов
+    void collectActiveUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> nameBuffer(std::max(maxLength, 1));
+
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+
+            GLint loc = glGetUniformLocation(ID, name.c_str());
+            if (loc < 0) continue; // члены uniform-блоков
+
+            activeUniforms[name] = loc;
+            // Массивы приходят как "name[0]": регистрируем и имя без индекса, и остальные элементы
+            size_t bracket = name.find("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size()) {
+                std::string base = name.substr(0, bracket);
+                activeUniforms[base] = loc;
+                for (GLint e = 1; e < size; ++e) {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    activeUniforms[element] = glGetUniformLocation(ID, element.c_str());
+                }
+            }
+        }
+    }
+
+    void resolveHandles() const {
+        const std::vector<std::string>& names = handleNames();
+        for (size_t slot = locations.size(); slot < names.size(); ++slot) {
+            auto it = activeUniforms.find(names[slot]);
+            locations.push_back(it != activeUniforms.end() ? it->second : -1);
+        }
+    }
+
+    static std::vector<std::string>& handleNames() {
+        static std::vector<std::string> names;
+        return names;
+    }
+    static std::unordered_map<std::string, int>& handleSlots() {
+        static std::unordered_map<std::string, int> slots;
+        return slots;
+    }
+
+    std::unordered_map<std::string, GLint> activeUniforms;
+    mutable std::vector<GLint> locations;
 };
 
 struct Vertex {
@@ -215,56 +331,426 @@ struct Vertex {
     float Weight;
 };
 
+// Формат вершин меша в GPU-буфере. Packed: 24 байта вместо 52 -
+// нормаль в GL_INT_2_10_10_10_REV, UV в half float, цвет и вес в RGBA8
+enum class VertexFormat { Float, Packed };
+
+struct PackedVertex {
+    glm::vec3 Position;
+    GLuint Normal;
+    GLushort TexCoords[2];
+    GLubyte Color[4];   // rgb + Weight в альфе
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex layout mismatch");
+
+// Вес и цвет в packed-формате ограничены [0, 1]
+PackedVertex packVertex(const Vertex& vertex) {
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    GLuint color = glm::packUnorm4x8(glm::vec4(vertex.Color, vertex.Weight));
+    memcpy(packed.Color, &color, sizeof(color));
+    return packed;
+}
+
+// Формат, который получают меши фабрик (--packed-vertices)
+VertexFormat defaultVertexFormat = VertexFormat::Float;
+
 struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
 };
 
+// Привязка VAO с запоминанием текущего: повторный bind того же VAO не доходит до драйвера
+unsigned int currentVAO = 0;
+
+void bindVertexArray(unsigned int vao) {
+    if (vao != currentVAO) {
+        glBindVertexArray(vao);
+        currentVAO = vao;
+    }
+}
+
+void deleteBuffer(GLuint id) { glDeleteBuffers(1, &id); }
+void deleteTexture(GLuint id) { glDeleteTextures(1, &id); }
+
+void deleteVertexArray(GLuint id) {
+    // Удалённый VAO отвязывается драйвером, а его имя может быть выдано снова
+    if (currentVAO == id) currentVAO = 0;
+    glDeleteVertexArrays(1, &id);
+}
+
+// Владеющая обёртка над именем GL-объекта: только перемещение, удаление в деструкторе.
+// Объекты должны освобождаться, пока контекст ещё жив
+template <void (*Delete)(GLuint)>
+class GLObject {
+public:
+    GLObject() : id(0) {}
+    explicit GLObject(GLuint handle) : id(handle) {}
+    ~GLObject() { reset(); }
+
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    GLObject(GLObject&& other) noexcept : id(other.id) { other.id = 0; }
+    GLObject& operator=(GLObject&& other) noexcept {
+        if (this != &other) {
+            reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    GLuint get() const { return id; }
+    explicit operator bool() const { return id != 0; }
+
+    GLuint release() {
+        GLuint handle = id;
+        id = 0;
+        return handle;
+    }
+
+    void reset(GLuint handle = 0) {
+        if (id != 0) Delete(id);
+        id = handle;
+    }
+
+private:
+    GLuint id;
+};
+
+using GLBuffer = GLObject<deleteBuffer>;
+using GLTexture = GLObject<deleteTexture>;
+using GLVertexArray = GLObject<deleteVertexArray>;
+
+GLBuffer makeBuffer() {
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    return GLBuffer(id);
+}
+
+// Формат команды для glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Все статические меши одного формата вершин живут в одной паре VBO/EBO с общим VAO;
+// меш хранит только baseVertex и смещение своих индексов
+class GeometryArena {
+public:
+    struct Allocation {
+        GLint baseVertex;
+        GLuint firstIndex;
+    };
+
+    static GeometryArena& instance(VertexFormat format = VertexFormat::Float) {
+        static GeometryArena floatArena(VertexFormat::Float);
+        static GeometryArena packedArena(VertexFormat::Packed);
+        return format == VertexFormat::Packed ? packedArena : floatArena;
+    }
+
+    // vertexData - count вершин в формате арены (Vertex или PackedVertex)
+    Allocation allocate(const void* vertexData, size_t count, const std::vector<unsigned int>& indices) {
+        if (!VAO) init();
+        ++liveAllocations;
+
+        Allocation allocation = {(GLint)vertexCount, (GLuint)indexCount};
+
+        if (reserve(VBO, vertexCapacity, vertexCount, count, stride)) setupVertexAttributes();
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+        glBufferSubData(GL_ARRAY_BUFFER, vertexCount * stride, count * stride, vertexData);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        vertexCount += count;
+
+        if (!indices.empty()) {
+            if (reserve(EBO, indexCapacity, indexCount, indices.size(), sizeof(unsigned int))) {
+                bindVertexArray(VAO.get());
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.get());
+                bindVertexArray(0);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, EBO.get());
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            indexCount += indices.size();
+        }
+
+        return allocation;
+    }
+
+    // Диапазоны не переиспользуются: когда уходит последний меш, арена отдаёт буферы и VAO целиком
+    void release() {
+        if (liveAllocations == 0 || --liveAllocations > 0) return;
+        VAO.reset();
+        VBO.reset();
+        EBO.reset();
+        vertexCapacity = vertexCount = 0;
+        indexCapacity = indexCount = 0;
+    }
+
+    unsigned int vao() const { return VAO.get(); }
+    size_t vertices() const { return vertexCount; }
+    size_t indices() const { return indexCount; }
+    size_t vertexBytes() const { return vertexCount * stride; }
+
+private:
+    explicit GeometryArena(VertexFormat fmt) :
+        format(fmt), stride(fmt == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex)),
+        vertexCapacity(0), vertexCount(0), indexCapacity(0), indexCount(0), liveAllocations(0) {}
+
+    void init() {
+        GLuint id = 0;
+        glGenVertexArrays(1, &id);
+        VAO.reset(id);
+        bindVertexArray(id);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(3);
+        glEnableVertexAttribArray(4);
+        bindVertexArray(0);
+    }
+
+    // Буфер растёт удвоением; старое содержимое копируется на стороне GPU,
+    // смещения мешей при этом не меняются. Возвращает true, если буфер пересоздан
+    bool reserve(GLBuffer& buffer, size_t& capacity, size_t used, size_t extra, size_t elementSize) {
+        if (buffer && used + extra <= capacity) return false;
+
+        size_t newCapacity = std::max(std::max(capacity * 2, used + extra), (size_t)65536);
+        GLBuffer newBuffer = makeBuffer();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, nullptr, GL_STATIC_DRAW);
+        if (buffer) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer.get());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used * elementSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer = std::move(newBuffer);
+        capacity = newCapacity;
+        return true;
+    }
+
+    void setupVertexAttributes() {
+        bindVertexArray(VAO.get());
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+        if (format == VertexFormat::Packed) {
+            // Шейдер видит те же vec3/vec2/vec3/float: распаковку делает нормализация атрибутов
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+            glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Color));
+            glVertexAttribPointer(4, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)(offsetof(PackedVertex, Color) + 3));
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            bindVertexArray(0);
+            return;
+        }
+        // Position
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // Normal
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // TexCoords
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // Color
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Color));
+        // Weight
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Weight));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bindVertexArray(0);
+    }
+
+    VertexFormat format;
+    size_t stride;
+    GLVertexArray VAO;
+    GLBuffer VBO, EBO;
+    size_t vertexCapacity, vertexCount;
+    size_t indexCapacity, indexCount;
+    size_t liveAllocations;
+};
+
+// Диапазон арены, занятый мешем. Копии меша (кэш, объекты сцены) делят его через shared_ptr,
+// последняя копия возвращает диапазон арене
+struct MeshGeometry {
+    VertexFormat format;
+    GLint baseVertex;
+    GLuint firstIndex;
+
+    MeshGeometry(VertexFormat fmt, const GeometryArena::Allocation& allocation) :
+        format(fmt), baseVertex(allocation.baseVertex), firstIndex(allocation.firstIndex) {}
+    ~MeshGeometry() { GeometryArena::instance(format).release(); }
+
+    MeshGeometry(const MeshGeometry&) = delete;
+    MeshGeometry& operator=(const MeshGeometry&) = delete;
+};
+
+// Ограничивающие объёмы в пространстве модели: сфера для быстрого теста, AABB для точного
+struct Bounds {
+    glm::vec3 min, max;
+    glm::vec3 center;
+    float radius;
+    bool valid;
+
+    Bounds() : min(0.0f), max(0.0f), center(0.0f), radius(0.0f), valid(false) {}
+
+    static Bounds fromVertices(const std::vector<Vertex>& vertices) {
+        Bounds bounds;
+        if (vertices.empty()) return bounds;
+        bounds.min = bounds.max = vertices[0].Position;
+        for (const auto& vertex : vertices) {
+            bounds.min = glm::min(bounds.min, vertex.Position);
+            bounds.max = glm::max(bounds.max, vertex.Position);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        for (const auto& vertex : vertices) bounds.radius = std::max(bounds.radius, glm::length(vertex.Position - bounds.center));
+        bounds.valid = true;
+        return bounds;
+    }
+};
+
 class Mesh {
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO;
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    VertexFormat format;
+    std::shared_ptr<MeshGeometry> geometry;
+    Bounds bounds;
 
     // Конструктор по умолчанию
-    Mesh() : VAO(0), VBO(0), EBO(0) {}
-
-    Mesh(std::vector<Vertex> verts, std::vector<unsigned int> inds, std::vector<Texture> texs) {
-        vertices = verts;
-        indices = inds;
-        textures = texs;
+    Mesh() : VAO(0), baseVertex(0), firstIndex(0), vertexCount(0), indexCount(0), format(VertexFormat::Float) {}
+
+    Mesh(std::vector<Vertex> verts, std::vector<unsigned int> inds, std::vector<Texture> texs,
+         VertexFormat fmt = defaultVertexFormat) :
+        vertices(std::move(verts)), indices(std::move(inds)), textures(std::move(texs)),
+        VAO(0), baseVertex(0), firstIndex(0), format(fmt) {
+        vertexCount = (GLsizei)vertices.size();
+        indexCount = (GLsizei)indices.size();
         setupMesh();
     }
 
+    // После загрузки в арену CPU-копия нужна только для повторной обработки геометрии
+    void releaseCPUData() {
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+    }
+
     void Draw(Shader &shader) {
         if (VAO == 0) return; 
+
+        bindTextures(shader);
+        DrawGeometry();
+    }
+
+    // Только draw-вызов: текстуры уже привязаны вызывающим (см. RenderQueue)
+    void DrawGeometry() {
+        if (VAO == 0) return;
+
+        bindVertexArray(VAO);
+        if(indexCount > 0) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT,
+                                     (void*)(firstIndex * sizeof(unsigned int)), baseVertex);
+        } else if(vertexCount > 0) {
+            glDrawArrays(GL_TRIANGLES, baseVertex, vertexCount);
+        }
+    }
+
+    // baseInstance != 0 требует GL 4.2 / ARB_base_instance
+    void DrawInstanced(Shader &shader, GLsizei instanceCount, GLuint baseInstance = 0) {
+        if (VAO == 0 || instanceCount == 0) return;
+
+        bindTextures(shader);
+
+        bindVertexArray(VAO);
+        if(indexCount > 0) {
+            void* offset = (void*)(firstIndex * sizeof(unsigned int));
+            if (baseInstance != 0) {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, offset,
+                                                              instanceCount, baseVertex, baseInstance);
+            } else {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, offset, instanceCount, baseVertex);
+            }
+        } else if(vertexCount > 0) {
+            if (baseInstance != 0) {
+                glDrawArraysInstancedBaseInstance(GL_TRIANGLES, baseVertex, vertexCount, instanceCount, baseInstance);
+            } else {
+                glDrawArraysInstanced(GL_TRIANGLES, baseVertex, vertexCount, instanceCount);
+            }
+        }
+    }
+
+    DrawElementsIndirectCommand indirectCommand(GLuint instanceCount, GLuint baseInstance) const {
+        DrawElementsIndirectCommand command = {(GLuint)indexCount, instanceCount, firstIndex, baseVertex, baseInstance};
+        return command;
+    }
+
+    // Подключает к VAO буфер с данными экземпляров (атрибуты 5-11, divisor = 1).
+    // VAO общий для всех мешей арены, поэтому offset задаёт первый экземпляр пачки
+    void attachInstanceBuffer(unsigned int instanceVBO, GLsizei stride, size_t offset = 0) {
+        if (VAO == 0) return;
+
+        bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // Model matrix: четыре столбца vec4
+        for (int column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        // Orbit: radius, speed, rotationSpeed, phase
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + sizeof(glm::vec4) * 4));
+        glVertexAttribDivisor(9, 1);
+        // Rotation axis
+        glEnableVertexAttribArray(10);
+        glVertexAttribPointer(10, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + sizeof(glm::vec4) * 5));
+        glVertexAttribDivisor(10, 1);
+        // Flags: useVertexColor, useGradient
+        glEnableVertexAttribArray(11);
+        glVertexAttribPointer(11, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + sizeof(glm::vec4) * 6));
+        glVertexAttribDivisor(11, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // (diffuse, specular): меши с одинаковым ключом привязывают одни и те же текстуры
+    std::pair<unsigned int, unsigned int> textureKey() const {
+        unsigned int diffuse = textures.size() > 0 ? textures[0].id : 0;
+        unsigned int specular = textures.size() > 1 ? textures[1].id : 0;
+        return std::make_pair(diffuse, specular);
+    }
+
+    void bindTextures(Shader &shader) {
+        static const Shader::Handle diffuseHandle = Shader::handle("material.diffuse");
+        static const Shader::Handle specularHandle = Shader::handle("material.specular");
         
         if (!textures.empty() && textures[0].id != 0) {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, textures[0].id);
-            shader.setInt("material.diffuse", 0);
+            shader.setInt(diffuseHandle, 0);
 
             if (textures.size() >= 2 && textures[1].id != 0) {
                 glActiveTexture(GL_TEXTURE1);
                 glBindTexture(GL_TEXTURE_2D, textures[1].id);
-                shader.setInt("material.specular", 1);
+                shader.setInt(specularHandle, 1);
             } else {
-                shader.setInt("material.specular", 0);
+                shader.setInt(specularHandle, 0);
             }
         } else {
-            shader.setInt("material.diffuse", 0);
-            shader.setInt("material.specular", 0);
-        }
-
-        glBindVertexArray(VAO);
-        if(indices.size() > 0) {
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        } else if(vertices.size() > 0) {
-            glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+            shader.setInt(diffuseHandle, 0);
+            shader.setInt(specularHandle, 0);
         }
-        glBindVertexArray(0);
     }
 
 private:
@@ -273,37 +759,22 @@ private:
             std::cerr << "Warning: Mesh has no vertices!" << std::endl;
             return;
         }
-        
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-        if(indices.size() > 0) {
-            glGenBuffers(1, &EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        GeometryArena& arena = GeometryArena::instance(format);
+        GeometryArena::Allocation allocation;
+        if (format == VertexFormat::Packed) {
+            std::vector<PackedVertex> packed;
+            packed.reserve(vertices.size());
+            for (const auto& vertex : vertices) packed.push_back(packVertex(vertex));
+            allocation = arena.allocate(packed.data(), packed.size(), indices);
+        } else {
+            allocation = arena.allocate(vertices.data(), vertices.size(), indices);
         }
-
-        // Position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // Normal
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // TexCoords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // Color
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Color));
-        // Weight
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Weight));
-
-        glBindVertexArray(0);
+        geometry = std::make_shared<MeshGeometry>(format, allocation);
+        bounds = Bounds::fromVertices(vertices);
+        VAO = arena.vao();
+        baseVertex = allocation.baseVertex;
+        firstIndex = allocation.firstIndex;
     }
 };
 
@@ -338,6 +809,185 @@ unsigned int loadTexture(const char *path) {
     return textureID;
 }
 
+// Асинхронная загрузка текстур: stb_image декодирует в пуле потоков, а главный поток
+// копирует готовые пиксели в PBO не больше uploadBudget байт за кадр. Текстура создаётся
+// сразу с серой заглушкой 1x1 и получает изображение целиком, когда PBO заполнен,
+// поэтому её id можно сразу отдавать мешам
+class TextureLoader {
+public:
+    explicit TextureLoader(size_t budget = 2 * 1024 * 1024) : uploadBudget(budget), stopping(false), pending(0), uploadOffset(0) {
+        // Флаг stb_image глобальный: выставляем его до запуска потоков
+        stbi_set_flip_vertically_on_load(true);
+    }
+
+    ~TextureLoader() { shutdown(); }
+
+    unsigned int request(const std::string& path) {
+        unsigned int textureID = 0;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char gray[4] = {128, 128, 128, 255};
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // Потоки запускаются при первом запросе: с --sync-textures и в --benchmark их нет
+        if (workers.empty()) {
+            unsigned int threads = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+            for (unsigned int i = 0; i < threads; ++i) {
+                workers.emplace_back(&TextureLoader::workerLoop, this);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({textureID, path});
+            ++pending;
+        }
+        wake.notify_one();
+        return textureID;
+    }
+
+    // Вызывается раз в кадр из потока с GL-контекстом
+    void update() {
+        size_t budget = uploadBudget;
+        while (budget > 0) {
+            if (!current.data) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty()) return;
+                current = std::move(decoded.front());
+                decoded.pop_front();
+                uploadOffset = 0;
+            }
+            size_t total = current.bytes();
+            if (uploadOffset == 0) {
+                if (!PBO) PBO = makeBuffer();
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO.get());
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+            } else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO.get());
+            }
+
+            size_t chunk = std::min(budget, total - uploadOffset);
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, uploadOffset, chunk,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (!dst) {
+                // Без этого куска PBO неполон: текстура остаётся с заглушкой
+                std::cerr << "Texture upload failed: glMapBufferRange returned null, texture " << current.textureID
+                          << " keeps its placeholder" << std::endl;
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                finishCurrent();
+                continue;
+            }
+            memcpy(dst, current.data.get() + uploadOffset, chunk);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            uploadOffset += chunk;
+            budget -= chunk;
+
+            if (uploadOffset == total) {
+                // Копирование из PBO в текстуру драйвер выполняет без ожидания на CPU
+                GLenum format = current.format();
+                glBindTexture(GL_TEXTURE_2D, current.textureID);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, current.width, current.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                finishCurrent();
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    bool busy() const { return pending.load() > 0; }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+        workers.clear();
+        PBO.reset();
+    }
+
+private:
+    struct StbiDeleter {
+        void operator()(unsigned char* data) const { stbi_image_free(data); }
+    };
+
+    struct Job {
+        unsigned int textureID;
+        std::string path;
+    };
+
+    struct DecodedImage {
+        unsigned int textureID = 0;
+        int width = 0, height = 0, components = 0;
+        std::unique_ptr<unsigned char, StbiDeleter> data;
+
+        size_t bytes() const { return (size_t)width * height * components; }
+        GLenum format() const {
+            if (components == 1) return GL_RED;
+            if (components == 4) return GL_RGBA;
+            return GL_RGB;
+        }
+    };
+
+    void workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            DecodedImage image;
+            image.textureID = job.textureID;
+            // Серый с альфой как GL_RG дал бы красно-зелёный цвет: такие изображения разворачиваются в RGBA
+            int width = 0, height = 0, components = 0;
+            int wanted = stbi_info(job.path.c_str(), &width, &height, &components) && components == 2 ? 4 : 0;
+            image.data.reset(stbi_load(job.path.c_str(), &image.width, &image.height, &image.components, wanted));
+            if (wanted) image.components = wanted;
+            if (!image.data) {
+                std::cerr << "Texture failed to load at path: " << job.path << std::endl;
+                --pending;
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(image));
+        }
+    }
+
+    void finishCurrent() {
+        current = DecodedImage();
+        uploadOffset = 0;
+        --pending;
+    }
+
+    size_t uploadBudget;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::deque<DecodedImage> decoded;
+    bool stopping;
+    std::atomic<int> pending;
+
+    DecodedImage current;
+    size_t uploadOffset;
+    GLBuffer PBO;
+};
+
 unsigned int createDynamicTexture(int width, int height) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
@@ -353,6 +1003,111 @@ unsigned int createDynamicTexture(int width, int height) {
     return textureID;
 }
 
+// Кольцо PBO для потоковой загрузки пикселей в текстуру. С GL 4.4 / ARB_buffer_storage
+// буфер отображён постоянно, а каждый слот защищён fence; иначе слот переразмечается
+// (orphaning) при каждом использовании. glTexSubImage2D читает из PBO на стороне драйвера,
+// поэтому главный поток не ждёт копирования, пока GPU использует предыдущие кадры
+class PixelUploadRing {
+public:
+    static const int SLOTS = 3;
+
+    PixelUploadRing() : slotSize(0), current(0), mapped(nullptr), persistent(false) {
+        for (int i = 0; i < SLOTS; ++i) fences[i] = 0;
+    }
+    ~PixelUploadRing() { release(); }
+
+    void init(size_t bytesPerSlot) {
+        release();
+        slotSize = bytesPerSlot;
+        persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+        if (persistent) {
+            buffers[0] = makeBuffer();
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[0].get());
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize * SLOTS, nullptr, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize * SLOTS, flags);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (!mapped) {
+                std::cerr << "Persistent PBO mapping failed, falling back to orphaning" << std::endl;
+                buffers[0].reset();
+                persistent = false;
+            }
+        }
+        if (!persistent) {
+            for (int i = 0; i < SLOTS; ++i) {
+                buffers[i] = makeBuffer();
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i].get());
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // Копирует прямоугольник w x h из src (rowLength пикселей RGBA8 в строке) в очередной слот
+    // и ставит в очередь его загрузку в texture
+    void upload(GLuint texture, int x, int y, int w, int h, const void* src, int rowLength) {
+        size_t rowBytes = (size_t)w * 4;
+        size_t bytes = rowBytes * h;
+        if (bytes == 0 || bytes > slotSize) return;
+
+        int slot = current;
+        current = (current + 1) % SLOTS;
+
+        unsigned char* dst = nullptr;
+        GLuint buffer = persistent ? buffers[0].get() : buffers[slot].get();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        if (persistent) {
+            // Слот свободен, когда GPU закончил загрузку из него SLOTS кадров назад
+            if (fences[slot]) {
+                glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                glDeleteSync(fences[slot]);
+                fences[slot] = 0;
+            }
+            dst = mapped + slot * slotSize;
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+            dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+
+        if (dst) {
+            const unsigned char* rows = (const unsigned char*)src;
+            for (int row = 0; row < h; ++row) memcpy(dst + row * rowBytes, rows + (size_t)row * rowLength * 4, rowBytes);
+            if (!persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            size_t offset = persistent ? slot * slotSize : 0;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+            if (persistent) fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    bool persistentMapped() const { return persistent; }
+
+    void release() {
+        for (int i = 0; i < SLOTS; ++i) {
+            if (fences[i]) glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[0].get());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            mapped = nullptr;
+        }
+        for (int i = 0; i < SLOTS; ++i) buffers[i].reset();
+    }
+
+private:
+    size_t slotSize;
+    int current;
+    unsigned char* mapped;
+    bool persistent;
+    GLBuffer buffers[SLOTS];
+    GLsync fences[SLOTS];
+};
+
 unsigned int createSolidColorTexture(glm::vec3 color) {
     unsigned int textureID = 0;
     
@@ -384,7 +1139,81 @@ unsigned int createSolidColorTexture(glm::vec3 color) {
     return textureID;
 }
 
+// Общий кэш ресурсов фабрик: одинаковая геометрия (форма + параметры + цвет) получает
+// один VAO/VBO/EBO, а одинаковый цвет - одну текстуру 1x1
+class ResourceCache {
+public:
+    static ResourceCache& instance() {
+        static ResourceCache cache;
+        return cache;
+    }
+
+    static std::string meshKey(const char* kind, std::initializer_list<float> params) {
+        std::string key(kind);
+        key.push_back((char)defaultVertexFormat);
+        for (float param : params) key.append((const char*)&param, sizeof(float));
+        return key;
+    }
+
+    unsigned int solidColorTexture(glm::vec3 color) {
+        // Ключ - тот же 8-битный RGB, что попадает в текстуру
+        unsigned int key = ((unsigned int)(unsigned char)(color.r * 255) << 16) |
+                           ((unsigned int)(unsigned char)(color.g * 255) << 8) |
+                           (unsigned int)(unsigned char)(color.b * 255);
+        auto it = textures.find(key);
+        if (it != textures.end()) {
+            ++textureHits;
+            return it->second.get();
+        }
+        ++textureMisses;
+        unsigned int id = createSolidColorTexture(color);
+        if (id != 0) textures.emplace(key, GLTexture(id));
+        return id;
+    }
+
+    bool findMesh(const std::string& key, Mesh& out) {
+        auto it = meshes.find(key);
+        if (it == meshes.end()) {
+            ++meshMisses;
+            return false;
+        }
+        ++meshHits;
+        out = it->second;
+        return true;
+    }
+
+    // Кэш раздаёт копии меша, которые делят геометрию в арене; CPU-массивы им не нужны
+    const Mesh& storeMesh(const std::string& key, Mesh mesh) {
+        mesh.releaseCPUData();
+        return meshes.emplace(key, std::move(mesh)).first->second;
+    }
+
+    // Освобождает текстуры и ссылки на геометрию; вызывается до удаления контекста
+    void clear() {
+        meshes.clear();
+        textures.clear();
+    }
+
+    void printStats() const {
+        std::cout << "Resource cache: meshes " << meshes.size() << " (hits " << meshHits << ", misses " << meshMisses
+                  << "), textures " << textures.size() << " (hits " << textureHits << ", misses " << textureMisses << ")" << std::endl;
+    }
+
+private:
+    ResourceCache() : meshHits(0), meshMisses(0), textureHits(0), textureMisses(0) {}
+
+    std::unordered_map<std::string, Mesh> meshes;
+    std::unordered_map<unsigned int, GLTexture> textures;
+    size_t meshHits, meshMisses;
+    size_t textureHits, textureMisses;
+};
+
 Mesh createCube(glm::vec3 color = glm::vec3(1.0f), float size = 1.0f) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("cube", {size, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     float s = size / 2.0f;
     std::vector<Vertex> vertices = {
         // Front face
@@ -428,17 +1257,22 @@ Mesh createCube(glm::vec3 color = glm::vec3(1.0f), float size = 1.0f) {
         20,21,22, 20,22,23  // Left
     };
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f, 0.5f, 0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f, 0.5f, 0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createSphere(float radius = 1.0f, int sectors = 36, int stacks = 18, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("sphere", {radius, (float)sectors, (float)stacks, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -482,17 +1316,22 @@ Mesh createSphere(float radius = 1.0f, int sectors = 36, int stacks = 18, glm::v
         }
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createCylinder(float radius = 0.5f, float height = 2.0f, int segments = 36, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("cylinder", {radius, height, (float)segments, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -572,17 +1411,22 @@ Mesh createCylinder(float radius = 0.5f, float height = 2.0f, int segments = 36,
         }
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createPlane(float size = 40.0f, glm::vec3 color = glm::vec3(0.2f, 0.6f, 0.3f), unsigned int textureID = 0) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("plane", {size, color.r, color.g, color.b, (float)textureID});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     float half = size / 2.0f;
     float uvScale = size / 10.0f; 
 
@@ -602,19 +1446,24 @@ Mesh createPlane(float size = 40.0f, glm::vec3 color = glm::vec3(0.2f, 0.6f, 0.3
     if (textureID != 0) {
         tex = textureID;
     } else {
-        tex = createSolidColorTexture(color);
+        tex = cache.solidColorTexture(color);
     }
 
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.1f)); 
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.1f)); 
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createPyramid(float base = 1.0f, float height = 1.5f, glm::vec3 color = glm::vec3(1.0f, 0.5f, 0.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("pyramid", {base, height, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     float half = base / 2.0f;
     std::vector<Vertex> vertices = {
         // Base vertices (counter-clockwise)
@@ -656,17 +1505,22 @@ Mesh createPyramid(float base = 1.0f, float height = 1.5f, glm::vec3 color = glm
         vertices[idx2].Normal = normal;
     }
     
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
     
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createTorus(float majorRadius = 1.0f, float minorRadius = 0.3f, int majorSegments = 36, int minorSegments = 18, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("torus", {majorRadius, minorRadius, (float)majorSegments, (float)minorSegments, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -705,17 +1559,22 @@ Mesh createTorus(float majorRadius = 1.0f, float minorRadius = 0.3f, int majorSe
         }
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createCone(float radius = 0.5f, float height = 2.0f, int segments = 36, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("cone", {radius, height, (float)segments, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -766,17 +1625,22 @@ Mesh createCone(float radius = 0.5f, float height = 2.0f, int segments = 36, glm
         indices.push_back(i + 1);
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createPrism(int sides = 6, float radius = 0.8f, float height = 2.0f, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("prism", {(float)sides, radius, height, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -863,17 +1727,22 @@ Mesh createPrism(int sides = 6, float radius = 0.8f, float height = 2.0f, glm::v
         vertices[indices[idx+2]].Normal = normal;
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createOctahedron(float size = 1.0f, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("octahedron", {size, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -926,17 +1795,22 @@ Mesh createOctahedron(float size = 1.0f, glm::vec3 color = glm::vec3(1.0f)) {
         indices.push_back(i * 3 + 2);
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createIcosahedron(float radius = 1.0f, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("icosahedron", {radius, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -982,17 +1856,22 @@ Mesh createIcosahedron(float radius = 1.0f, glm::vec3 color = glm::vec3(1.0f)) {
         indices.push_back(i * 3 + 2);
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
 }
 
 Mesh createHelix(float radius = 1.0f, float height = 3.0f, float turns = 3.0f, int segments = 100, glm::vec3 color = glm::vec3(1.0f)) {
+    ResourceCache& cache = ResourceCache::instance();
+    const std::string key = ResourceCache::meshKey("helix", {radius, height, turns, (float)segments, color.r, color.g, color.b});
+    Mesh cached;
+    if (cache.findMesh(key, cached)) return cached;
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -1038,25 +1917,87 @@ Mesh createHelix(float radius = 1.0f, float height = 3.0f, float turns = 3.0f, i
         indices.push_back(idx + 2);
     }
 
-    unsigned int tex = createSolidColorTexture(color);
-    unsigned int specTex = createSolidColorTexture(glm::vec3(0.5f));
+    unsigned int tex = cache.solidColorTexture(color);
+    unsigned int specTex = cache.solidColorTexture(glm::vec3(0.5f));
     std::vector<Texture> textures = {
         {tex, "diffuse", ""},
         {specTex, "specular", ""}
     };
 
-    return Mesh(vertices, indices, textures);
+    return cache.storeMesh(key, Mesh(std::move(vertices), std::move(indices), std::move(textures)));
+}
+
+// Уровни детализации: уровень level строится с тесселяцией, уменьшенной в 2^level раз
+const int LOD_LEVELS = 4;
+// Диаметр ограничивающей сферы на экране (пиксели), ниже которого выбирается следующий уровень
+const float LOD_SCREEN_SIZE[LOD_LEVELS - 1] = {48.0f, 24.0f, 12.0f};
+// Доля порога, на которую нужно его пересечь, чтобы уровень сменился: без неё объект
+// на границе переключался бы каждый кадр
+const float LOD_HYSTERESIS = 0.15f;
+
+int lodSegments(int segments, int level, int minimum) {
+    return std::max(minimum, segments >> level);
+}
+
+// Уровни 1..LOD_LEVELS-1 для SceneObject::lods; factory(level) возвращает меш уровня
+template <class Factory>
+std::vector<Mesh> createLODs(Factory factory) {
+    std::vector<Mesh> lods;
+    for (int level = 1; level < LOD_LEVELS; ++level) lods.push_back(factory(level));
+    return lods;
 }
 
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
+// Плоскости отсечения камеры; от них же зависят срезы кластеров, каскады теней и ключ глубины RenderQueue
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 200.0f;
 
 bool directionalLightEnabled = true;
 bool pointLightEnabled = true;
 bool spotLightEnabled = true;
 
+bool instancedRendering = false;
+bool gpuAnimation = false;
+bool multiDrawIndirect = true;
+bool frustumCulling = true;
+bool levelOfDetail = true;
+bool sortedDraws = true;
+bool shadowsEnabled = true;
+int shadowMapSize = 1024;
+int extraLightCount = 0;
+bool clusteredLighting = true;
+float lightsPerClusterAverage = 0.0f;
+unsigned int lightsPerClusterMax = 0;
+bool deferredShading = false;
+bool depthPrepass = false;
+// Полупрозрачный монолит: единственный объект сцены, идущий через проход со смешиванием
+bool glassMonolith = false;
+std::string profileCsvPath;
+std::string profileTracePath;
+// Бенчмарк без окна: фиксированный путь камеры, заданное число кадров в FBO без vsync
+int benchmarkFrames = 0;
+bool benchmarkChecksum = false;
+const float BENCHMARK_STEP = 1.0f / 60.0f;
+// Кадровый буфер, в который выводится сцена: окно (0) или FBO бенчмарка
+GLuint outputFramebuffer = 0;
+size_t stateChangesAvoided = 0;
+size_t objectsPerLod[LOD_LEVELS] = {};
+size_t objectsDrawn = 0;
+size_t objectsCulled = 0;
+int asteroidCount = 0;
+bool asyncTextures = true;
+bool tiledRaster = true;
+bool rasterThread = false;
+int softwareTextureSize = 512;
+std::string rasterBackendOverride;
+
 glm::vec3 pointLightPos = glm::vec3(5.0f, 5.0f, 5.0f);
 
+// Выставляется processInput при любом изменении камеры или источников света:
+// только тогда UBO со светом и матрицами перезаписывается
+bool sceneUniformsDirty = true;
+
 Camera camera(glm::vec3(0.0f, 30.0f, 50.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, -40.0f);
 
 struct SceneObject {
@@ -1072,57 +2013,727 @@ struct SceneObject {
     
     float orbitRadius;
     float orbitSpeed;
+    float orbitPhase;
+
+    // Более грубые уровни детализации (уровень 0 - сам mesh) и выбранный в последнем кадре
+    std::vector<Mesh> lods;
+    int lod;
+
+    // Меньше 1 - объект рисуется со смешиванием после всех непрозрачных
+    float opacity;
     
     SceneObject() : 
         mesh(), position(0.0f), scale(1.0f), 
         rotationSpeed(0.0f), rotationAxis(0.0f, 1.0f, 0.0f),
         useVertexColor(true), useGradient(false), color(1.0f), name("Object"),
-        orbitRadius(0.0f), orbitSpeed(0.0f)
+        orbitRadius(0.0f), orbitSpeed(0.0f), orbitPhase(0.0f), lod(0), opacity(1.0f)
     {}
     
-    SceneObject(const Mesh& m, const glm::vec3& pos, const glm::vec3& scl, 
+    SceneObject(Mesh m, const glm::vec3& pos, const glm::vec3& scl, 
                 float rotSpeed, const glm::vec3& rotAxis, bool useVertCol,
-                bool useGrad, const glm::vec3& col, const std::string& n,
-                float oRadius = 0.0f, float oSpeed = 0.0f) :
-        mesh(m), position(pos), scale(scl),
+                bool useGrad, const glm::vec3& col, std::string n,
+                float oRadius = 0.0f, float oSpeed = 0.0f, float oPhase = 0.0f) :
+        mesh(std::move(m)), position(pos), scale(scl),
         rotationSpeed(rotSpeed), rotationAxis(rotAxis),
-        useVertexColor(useVertCol), useGradient(useGrad), color(col), name(n),
-        orbitRadius(oRadius), orbitSpeed(oSpeed)
+        useVertexColor(useVertCol), useGradient(useGrad), color(col), name(std::move(n)),
+        orbitRadius(oRadius), orbitSpeed(oSpeed), orbitPhase(oPhase), lod(0), opacity(1.0f)
     {}
+
+    // Неподвижный объект: в картах теней рисуется обычным вызовом, а не из буфера экземпляров
+    bool isStatic() const { return rotationSpeed == 0.0f && orbitRadius == 0.0f; }
+    bool isTranslucent() const { return opacity < 1.0f; }
+
+    int lodCount() const { return 1 + (int)lods.size(); }
+    Mesh& lodMesh(int level) { return level == 0 ? mesh : lods[level - 1]; }
+
+    // pixelsPerUnit - размер единицы мира на экране на единичном расстоянии от камеры
+    void selectLod(const glm::mat4& model, const glm::vec3& cameraPos, float pixelsPerUnit) {
+        glm::vec3 center(model * glm::vec4(mesh.bounds.center, 1.0f));
+        selectLod(center, mesh.bounds.radius * std::max(scale.x, std::max(scale.y, scale.z)), cameraPos, pixelsPerUnit);
+    }
+
+    // По готовой ограничивающей сфере в мире (center, radius)
+    void selectLod(const glm::vec3& center, float radius, const glm::vec3& cameraPos, float pixelsPerUnit) {
+        if (lods.empty() || !mesh.bounds.valid) {
+            lod = 0;
+            return;
+        }
+        float distance = glm::length(center - cameraPos);
+        float screenSize = distance > radius ? 2.0f * radius * pixelsPerUnit / distance : 1e9f;
+
+        while (lod > 0 && screenSize > LOD_SCREEN_SIZE[lod - 1] * (1.0f + LOD_HYSTERESIS)) --lod;
+        while (lod < lodCount() - 1 && screenSize < LOD_SCREEN_SIZE[lod] * (1.0f - LOD_HYSTERESIS)) ++lod;
+    }
+
+    // Без гистерезиса и без записи в lod: для проходов со своим разрешением (карты теней)
+    int lodForScreenSize(float screenSize) const {
+        if (lods.empty() || !mesh.bounds.valid) return 0;
+        int level = 0;
+        while (level < lodCount() - 1 && screenSize < LOD_SCREEN_SIZE[level]) ++level;
+        return level;
+    }
+
+    glm::vec3 orbitOffset(float totalTime) const {
+        float orbitX = cos(totalTime * orbitSpeed + orbitPhase) * orbitRadius;
+        float orbitZ = sin(totalTime * orbitSpeed + orbitPhase) * orbitRadius;
+        return glm::vec3(orbitX, 0.0f, orbitZ);
+    }
+
+    // Ограничивающая сфера в мире без построения матрицы (xyz - центр, w - радиус):
+    // поворачивается только центр границ
+    glm::vec4 boundingSphere(float totalTime) const {
+        glm::vec3 center = mesh.bounds.center * scale;
+        if (rotationSpeed != 0.0f) {
+            // Формула Родрига
+            glm::vec3 axis = glm::normalize(rotationAxis);
+            float c = cos(totalTime * rotationSpeed), s = sin(totalTime * rotationSpeed);
+            center = center * c + glm::cross(axis, center) * s + axis * glm::dot(axis, center) * (1.0f - c);
+        }
+        float radius = mesh.bounds.radius * std::max(scale.x, std::max(scale.y, scale.z));
+        return glm::vec4(position + orbitOffset(totalTime) + center, radius);
+    }
+
+    glm::mat4 modelMatrix(float totalTime) const {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position + orbitOffset(totalTime));
+        if (rotationSpeed != 0.0f) {
+            model = glm::rotate(model, totalTime * rotationSpeed, rotationAxis);
+        }
+        return glm::scale(model, scale);
+    }
+
+    // Неизменная часть трансформации для GPU-анимации: орбита и вращение добавляются в вершинном шейдере
+    glm::mat4 baseMatrix() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), position), scale);
+    }
 };
 
-const char* vertexShaderSource = R"(
-#version 330 core
+// Плоскости пирамиды видимости, извлечённые из projection * view; нормали смотрят внутрь
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& viewProjection) {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; ++i) {
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            planes[axis * 2] = row[3] + row[axis];
+            planes[axis * 2 + 1] = row[3] - row[axis];
+        }
+        for (auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool visible(const glm::vec4& sphere) const {
+        for (const auto& plane : planes) {
+            if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w) return false;
+        }
+        return true;
+    }
+
+    // Объём без границ (пустой меш) считается видимым
+    bool visible(const Bounds& bounds, const glm::mat4& model) const {
+        if (!bounds.valid) return true;
+
+        glm::vec3 axisX(model[0]), axisY(model[1]), axisZ(model[2]);
+        glm::vec3 center(model * glm::vec4(bounds.center, 1.0f));
+        float radius = bounds.radius * std::max(glm::length(axisX), std::max(glm::length(axisY), glm::length(axisZ)));
+
+        // AABB после поворота и масштаба: центр переносится, полуразмеры проецируются на мировые оси
+        glm::vec3 half = (bounds.max - bounds.min) * 0.5f;
+        glm::vec3 boxCenter(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+        glm::vec3 extent = glm::abs(axisX) * half.x + glm::abs(axisY) * half.y + glm::abs(axisZ) * half.z;
+
+        for (const auto& plane : planes) {
+            glm::vec3 normal(plane);
+            if (glm::dot(normal, center) + plane.w < -radius) return false;
+            if (glm::dot(normal, boxCenter) + plane.w + glm::dot(glm::abs(normal), extent) < 0.0f) return false;
+        }
+        return true;
+    }
+};
+
+// Данные одного экземпляра в instance VBO (см. Mesh::attachInstanceBuffer)
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 orbit;        // orbitRadius, orbitSpeed, rotationSpeed, orbitPhase
+    glm::vec4 rotationAxis;
+    glm::vec2 flags;        // useVertexColor, useGradient
+};
+
+// Объекты с общим Mesh (один диапазон арены и набор текстур) рисуются одним instanced-вызовом.
+// Каждый объект занимает постоянное место в instance VBO в каждой своей пачке. С glMultiDrawElementsIndirect
+// отсечение и выбор уровня детализации только собирают из подряд выбранных мест команды
+// (instanceCount, baseInstance), и команды с одинаковыми текстурами уходят одним вызовом.
+// Без него выбранные экземпляры копируются подряд в буфер выборки: один вызов на пачку
+class InstancedRenderer {
+public:
+    // Команды одной выборки объектов: собираются один раз и могут рисоваться несколькими проходами
+    struct DrawList {
+        struct Run {
+            size_t batch;
+            GLuint firstInstance;
+            GLuint instanceCount;
+        };
+        std::vector<Run> runs;
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLBuffer indirectBuffer;
+        // Без multi-draw: выбранные экземпляры подряд, runs адресуют этот буфер
+        std::vector<InstanceData> compacted;
+        GLBuffer instanceBuffer;
+
+        void release() {
+            indirectBuffer.reset();
+            instanceBuffer.reset();
+        }
+    };
+
+    InstancedRenderer() : staticUploaded(false),
+                          hasBaseInstance(false), hasMultiDrawIndirect(false), multiDrawIndirect(true) {}
+
+    void build(std::vector<SceneObject>& objects) {
+        batches.clear();
+        hasBaseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+        hasMultiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+
+        // Объект попадает в пачку каждого своего уровня детализации, а в кадре рисуется только в одной
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (int level = 0; level < objects[i].lodCount(); ++level) {
+                Mesh& mesh = objects[i].lodMesh(level);
+                if (mesh.VAO == 0) continue;
+
+                Batch* target = nullptr;
+                for (auto& batch : batches) {
+                    if (batch.lod == level && sameMesh(*batch.mesh, mesh)) {
+                        target = &batch;
+                        break;
+                    }
+                }
+                if (!target) {
+                    batches.push_back(Batch());
+                    target = &batches.back();
+                    target->mesh = &mesh;
+                    target->lod = level;
+                }
+                target->objects.push_back(i);
+            }
+        }
+
+        // Пачки с одинаковыми VAO и текстурами идут подряд, чтобы их можно было отдать одним multi-draw
+        std::stable_sort(batches.begin(), batches.end(), [](const Batch& a, const Batch& b) {
+            return stateKey(*a.mesh) < stateKey(*b.mesh);
+        });
+
+        GLuint firstInstance = 0;
+        for (auto& batch : batches) {
+            batch.firstInstance = firstInstance;
+            firstInstance += (GLuint)batch.objects.size();
+        }
+        instances.resize(firstInstance);
+        staticUploaded = false;
+
+        // Буфер сразу получает полный размер: VAO арены общий, и обычные draw-вызовы тоже читают экземпляр 0
+        if (!instanceVBO) instanceVBO = makeBuffer();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(instances.size(), 1) * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        attachToAllArenas(instanceVBO.get());
+    }
+
+    // Раз в кадр, до всех draw. С gpuAnimation буфер заполняется один раз статическими параметрами,
+    // а позиция на орбите и поворот считаются в шейдере по uniform time; иначе матрицы пишутся заново
+    void update(const std::vector<SceneObject>& objects, float totalTime, bool gpuAnimation) {
+        if (batches.empty() || (gpuAnimation && staticUploaded)) return;
+
+        // Объект лежит в пачке каждого уровня детализации, а матрица считается один раз
+        models.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            models[i] = gpuAnimation ? objects[i].baseMatrix() : objects[i].modelMatrix(totalTime);
+        }
+        for (const auto& batch : batches) {
+            for (size_t k = 0; k < batch.objects.size(); ++k) {
+                const SceneObject& object = objects[batch.objects[k]];
+                InstanceData& instance = instances[batch.firstInstance + k];
+                instance.model = models[batch.objects[k]];
+                instance.orbit = glm::vec4(object.orbitRadius, object.orbitSpeed, object.rotationSpeed, object.orbitPhase);
+                instance.rotationAxis = glm::vec4(glm::normalize(object.rotationAxis), 0.0f);
+                instance.flags = glm::vec2(object.useVertexColor ? 1.0f : 0.0f, object.useGradient ? 1.0f : 0.0f);
+            }
+        }
+
+        // Orphaning: драйвер отдаёт новый буфер, не дожидаясь кадра, который ещё читает старый
+        GLsizeiptr bytes = instances.size() * sizeof(InstanceData);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, gpuAnimation ? GL_STATIC_DRAW : GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        staticUploaded = gpuAnimation;
+    }
+
+    // selection (по индексу объекта): 0 - не рисовать, иначе номер уровня детализации + 1; без него - все на уровне 0.
+    // С multi-draw в GPU уходят только команды; иначе - выбранные экземпляры, по одному диапазону на пачку
+    void select(DrawList& list, const std::vector<unsigned char>* selection) const {
+        list.runs.clear();
+        list.commands.clear();
+        list.compacted.clear();
+        bool indirect = hasMultiDrawIndirect && multiDrawIndirect;
+        for (size_t b = 0; b < batches.size(); ++b) {
+            const Batch& batch = batches[b];
+            auto selected = [&](size_t k) {
+                return (selection ? (int)(*selection)[batch.objects[k]] : 1) == batch.lod + 1;
+            };
+            if (!indirect) {
+                GLuint first = (GLuint)list.compacted.size();
+                for (size_t k = 0; k < batch.objects.size(); ++k) {
+                    if (selected(k)) list.compacted.push_back(instances[batch.firstInstance + k]);
+                }
+                GLuint count = (GLuint)list.compacted.size() - first;
+                if (count > 0) list.runs.push_back({b, first, count});
+                continue;
+            }
+            for (size_t k = 0; k < batch.objects.size(); ++k) {
+                if (!selected(k)) continue;
+                size_t start = k;
+                while (k + 1 < batch.objects.size() && selected(k + 1)) ++k;
+                list.runs.push_back({b, batch.firstInstance + (GLuint)start, (GLuint)(k + 1 - start)});
+            }
+        }
+        if (list.runs.empty()) return;
+
+        if (!indirect) {
+            // Orphaning, как и у основного буфера
+            GLsizeiptr bytes = list.compacted.size() * sizeof(InstanceData);
+            if (!list.instanceBuffer) list.instanceBuffer = makeBuffer();
+            glBindBuffer(GL_ARRAY_BUFFER, list.instanceBuffer.get());
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, list.compacted.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+
+        for (const auto& run : list.runs) {
+            list.commands.push_back(batches[run.batch].mesh->indirectCommand(run.instanceCount, run.firstInstance));
+        }
+        if (!list.indirectBuffer) list.indirectBuffer = makeBuffer();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list.indirectBuffer.get());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, list.commands.size() * sizeof(DrawElementsIndirectCommand),
+                     list.commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void draw(Shader& shader, const DrawList& list) {
+        if (list.runs.empty()) return;
+
+        if (!list.commands.empty()) {
+            drawIndirect(shader, list);
+            return;
+        }
+
+        // Атрибуты экземпляра на время выборки читают её буфер; VAO общий на арену
+        if (hasBaseInstance) attachToAllArenas(list.instanceBuffer.get());
+        for (const auto& run : list.runs) {
+            Mesh* mesh = batches[run.batch].mesh;
+            if (hasBaseInstance) {
+                mesh->DrawInstanced(shader, (GLsizei)run.instanceCount, run.firstInstance);
+            } else {
+                // Без ARB_base_instance сдвигаем указатели атрибутов экземпляра на начало диапазона
+                mesh->attachInstanceBuffer(list.instanceBuffer.get(), sizeof(InstanceData), run.firstInstance * sizeof(InstanceData));
+                mesh->DrawInstanced(shader, (GLsizei)run.instanceCount);
+            }
+        }
+        attachToAllArenas(instanceVBO.get());
+    }
+
+    void setMultiDrawIndirect(bool enabled) { multiDrawIndirect = enabled; }
+    bool multiDrawIndirectActive() const { return hasMultiDrawIndirect && multiDrawIndirect; }
+    size_t batchCount() const { return batches.size(); }
+
+    void clear() {
+        batches.clear();
+        std::vector<InstanceData>().swap(instances);
+        std::vector<glm::mat4>().swap(models);
+        instanceVBO.reset();
+        staticUploaded = false;
+    }
+
+private:
+    struct Batch {
+        Mesh* mesh = nullptr;
+        int lod = 0;
+        GLuint firstInstance = 0;
+        std::vector<size_t> objects;
+    };
+
+    // Команды лежат в indirect-буфере в порядке пачек: один вызов на группу с общими текстурами
+    void drawIndirect(Shader& shader, const DrawList& list) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list.indirectBuffer.get());
+
+        size_t first = 0;
+        while (first < list.runs.size()) {
+            Mesh& mesh = *batches[list.runs[first].batch].mesh;
+            size_t last = first + 1;
+            while (last < list.runs.size() && stateKey(*batches[list.runs[last].batch].mesh) == stateKey(mesh)) ++last;
+
+            bindVertexArray(mesh.VAO);
+            mesh.bindTextures(shader);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)(last - first), 0);
+            first = last;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Первый экземпляр каждой арены (float/packed) читают и обычные draw-вызовы
+    void attachToAllArenas(GLuint buffer) {
+        std::vector<unsigned int> attached;
+        for (const auto& batch : batches) {
+            if (std::find(attached.begin(), attached.end(), batch.mesh->VAO) != attached.end()) continue;
+            batch.mesh->attachInstanceBuffer(buffer, sizeof(InstanceData));
+            attached.push_back(batch.mesh->VAO);
+        }
+    }
+
+    static std::pair<unsigned int, std::pair<unsigned int, unsigned int>> stateKey(const Mesh& mesh) {
+        return std::make_pair(mesh.VAO, mesh.textureKey());
+    }
+
+    static bool sameMesh(const Mesh& a, const Mesh& b) {
+        return a.VAO == b.VAO && a.baseVertex == b.baseVertex && a.firstIndex == b.firstIndex &&
+               a.indexCount == b.indexCount && a.textureKey() == b.textureKey();
+    }
+
+    std::vector<Batch> batches;
+    std::vector<InstanceData> instances;
+    std::vector<glm::mat4> models;
+    GLBuffer instanceVBO;
+    bool staticUploaded;
+    bool hasBaseInstance;
+    bool hasMultiDrawIndirect;
+    bool multiDrawIndirect;
+};
+
+// Очередь обычных draw-вызовов кадра, отсортированная по 64-битному ключу (от старших битов):
+// шейдер (8) | набор текстур (16) | флаги useVertexColor/useGradient (2) | меш (22) | глубина (16).
+// Подряд идущие вызовы с общим состоянием его не перевыставляют, а внутри одного состояния
+// непрозрачные объекты рисуются спереди назад, чтобы ранний тест глубины отбрасывал перекрытое
+class RenderQueue {
+public:
+    RenderQueue() : skipped(0) {}
+
+    void clear() { items.clear(); }
+
+    // depth - расстояние от камеры, нормированное на дальнюю плоскость
+    void add(unsigned int shaderSlot, SceneObject& object, Mesh& mesh, const glm::mat4& model, float depth) {
+        uint64_t quantizedDepth = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * 65535.0f);
+        uint64_t flags = (object.useVertexColor ? 2 : 0) | (object.useGradient ? 1 : 0);
+        uint64_t key = ((uint64_t)(shaderSlot & 0xFF) << 56) | ((uint64_t)textureSetId(mesh) << 40) |
+                       (flags << 38) | ((uint64_t)(meshId(mesh) & 0x3FFFFF) << 16) | quantizedDepth;
+        items.push_back(Item{key, &object, &mesh, model});
+    }
+
+    void sort() {
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+    }
+
+    void draw(Shader& shader) {
+        static const Shader::Handle modelHandle = Shader::handle("model");
+        static const Shader::Handle useVertexColorHandle = Shader::handle("useVertexColor");
+        static const Shader::Handle useGradientHandle = Shader::handle("useGradient");
+
+        skipped = 0;
+        const Mesh* lastTextures = nullptr;
+        int lastVertexColor = -1, lastGradient = -1;
+        for (const Item& item : items) {
+            if (item.mesh->VAO == 0) continue;
+
+            if (lastTextures && lastTextures->textureKey() == item.mesh->textureKey()) {
+                ++skipped;
+            } else {
+                item.mesh->bindTextures(shader);
+                lastTextures = item.mesh;
+            }
+            if (lastVertexColor == (int)item.object->useVertexColor) {
+                ++skipped;
+            } else {
+                lastVertexColor = item.object->useVertexColor;
+                shader.setBool(useVertexColorHandle, item.object->useVertexColor);
+            }
+            if (lastGradient == (int)item.object->useGradient) {
+                ++skipped;
+            } else {
+                lastGradient = item.object->useGradient;
+                shader.setBool(useGradientHandle, item.object->useGradient);
+            }
+
+            shader.setMat4(modelHandle, item.model);
+            item.mesh->DrawGeometry();
+        }
+    }
+
+    // Только глубина для предварительного прохода: материалы не нужны, поэтому порядок строго спереди назад
+    void drawDepth(Shader& shader) {
+        static const Shader::Handle modelHandle = Shader::handle("model");
+
+        depthOrder.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) depthOrder[i] = &items[i];
+        std::sort(depthOrder.begin(), depthOrder.end(),
+                  [](const Item* a, const Item* b) { return (a->key & 0xFFFF) < (b->key & 0xFFFF); });
+        for (const Item* item : depthOrder) {
+            if (item->mesh->VAO == 0) continue;
+            shader.setMat4(modelHandle, item->model);
+            item->mesh->DrawGeometry();
+        }
+    }
+
+    // Смены текстур и uniform-флагов, пропущенные в последнем draw
+    size_t stateChangesSkipped() const { return skipped; }
+
+private:
+    struct Item {
+        uint64_t key;
+        SceneObject* object;
+        Mesh* mesh;
+        glm::mat4 model;
+    };
+
+    // Компактные номера для полей ключа; таблицы живут всё время работы, как и кэш ресурсов
+    uint16_t textureSetId(const Mesh& mesh) {
+        auto key = mesh.textureKey();
+        auto it = textureSets.find(key);
+        if (it != textureSets.end()) return it->second;
+        uint16_t id = (uint16_t)textureSets.size();
+        textureSets.emplace(key, id);
+        return id;
+    }
+
+    // Копии меша из кэша делят один диапазон арены, и он однозначно задаёт геометрию
+    uint32_t meshId(const Mesh& mesh) {
+        auto it = meshes.find(mesh.geometry.get());
+        if (it != meshes.end()) return it->second;
+        uint32_t id = (uint32_t)meshes.size();
+        meshes.emplace(mesh.geometry.get(), id);
+        return id;
+    }
+
+    struct PairHash {
+        size_t operator()(const std::pair<unsigned int, unsigned int>& p) const {
+            return std::hash<uint64_t>()(((uint64_t)p.first << 32) | p.second);
+        }
+    };
+
+    std::vector<Item> items;
+    std::vector<const Item*> depthOrder;
+    std::unordered_map<std::pair<unsigned int, unsigned int>, uint16_t, PairHash> textureSets;
+    std::unordered_map<const MeshGeometry*, uint32_t> meshes;
+    size_t skipped;
+};
+
+// Зеркала std140-блоков из шейдеров: скаляры уложены в хвост vec3, bool занимает 4 байта
+struct DirLightBlock {
+    glm::vec3 direction;
+    int enabled;
+    glm::vec3 ambient;
+    float pad0;
+    glm::vec3 diffuse;
+    float pad1;
+    glm::vec3 specular;
+    float pad2;
+};
+
+struct PointLightBlock {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    int enabled;
+};
+
+struct SpotLightBlock {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutOff;
+    glm::vec3 specular;
+    float outerCutOff;
+    int enabled;
+    float pad[3];
+};
+
+struct LightsBlock {
+    DirLightBlock dirLight;
+    PointLightBlock pointLight;
+    SpotLightBlock spotLight;
+};
+
+struct MatricesBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad;
+};
+
+static_assert(sizeof(DirLightBlock) == 64, "DirLight std140 layout mismatch");
+static_assert(sizeof(PointLightBlock) == 64, "PointLight std140 layout mismatch");
+static_assert(sizeof(SpotLightBlock) == 96, "SpotLight std140 layout mismatch");
+static_assert(sizeof(MatricesBlock) == 144, "Matrices std140 layout mismatch");
+
+// Один постоянный UBO на оба блока; обновляется одним glBufferSubData
+class SceneUniforms {
+public:
+    static const GLuint MATRICES_BINDING = 0;
+    static const GLuint LIGHTS_BINDING = 1;
+
+    SceneUniforms() : lightsOffset(0) {}
+
+    void init() {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = ((sizeof(MatricesBlock) + alignment - 1) / alignment) * alignment;
+        staging.assign(lightsOffset + sizeof(LightsBlock), 0);
+
+        UBO = makeBuffer();
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO.get());
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, MATRICES_BINDING, UBO.get(), 0, sizeof(MatricesBlock));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, UBO.get(), lightsOffset, sizeof(LightsBlock));
+    }
+
+    void upload(const MatricesBlock& matrices, const LightsBlock& lights) {
+        memcpy(staging.data(), &matrices, sizeof(MatricesBlock));
+        memcpy(staging.data() + lightsOffset, &lights, sizeof(LightsBlock));
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO.get());
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void release() { UBO.reset(); }
+
+private:
+    GLBuffer UBO;
+    size_t lightsOffset;
+    std::vector<unsigned char> staging;
+};
+
+LightsBlock buildLightsBlock() {
+    LightsBlock lights = {};
+
+    lights.dirLight.direction = glm::vec3(-0.5f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.dirLight.diffuse = glm::vec3(0.8f, 0.8f, 0.6f);
+    lights.dirLight.specular = glm::vec3(1.0f, 1.0f, 0.9f);
+    lights.dirLight.enabled = directionalLightEnabled;
+
+    lights.pointLight.position = pointLightPos;
+    lights.pointLight.constant = 1.0f;
+    lights.pointLight.linear = 0.09f;
+    lights.pointLight.quadratic = 0.032f;
+    lights.pointLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    lights.pointLight.diffuse = glm::vec3(0.8f, 0.8f, 0.7f);
+    lights.pointLight.specular = glm::vec3(1.0f, 1.0f, 0.9f);
+    lights.pointLight.enabled = pointLightEnabled;
+
+    lights.spotLight.position = camera.Position;
+    lights.spotLight.direction = camera.Front;
+    lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+    lights.spotLight.outerCutOff = glm::cos(glm::radians(20.0f));
+    lights.spotLight.constant = 1.0f;
+    lights.spotLight.linear = 0.02f;
+    lights.spotLight.quadratic = 0.005f;
+    lights.spotLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.spotLight.diffuse = glm::vec3(3.0f, 3.0f, 3.0f);
+    lights.spotLight.specular = glm::vec3(3.0f, 3.0f, 3.0f);
+    lights.spotLight.enabled = spotLightEnabled;
+
+    return lights;
+}
+
+// Матрица объекта для обычного, instanced и GPU-анимированного рисования;
+// общая для вершинных шейдеров сцены и карт теней
+const char* objectTransformSource = R"(
 layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in vec4 aInstanceOrbit;
+layout (location = 10) in vec4 aInstanceAxis;
+
+uniform mat4 model;
+uniform bool instanced;
+uniform bool gpuAnimation;
+uniform float time;
+
+// Та же матрица, что строит glm::rotate (ось уже нормализована на CPU)
+mat3 axisRotation(vec3 axis, float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 t = axis * (1.0 - c);
+    return mat3(
+        c + t.x * axis.x,          t.x * axis.y + s * axis.z, t.x * axis.z - s * axis.y,
+        t.y * axis.x - s * axis.z, c + t.y * axis.y,          t.y * axis.z + s * axis.x,
+        t.z * axis.x + s * axis.y, t.z * axis.y - s * axis.x, c + t.z * axis.z
+    );
+}
+
+mat4 ObjectModel() {
+    if (!instanced) return model;
+    if (!gpuAnimation) return aInstanceModel;
+    // aInstanceModel = translate(position) * scale(scale), aInstanceOrbit = (radius, speed, rotationSpeed, phase)
+    float orbitAngle = time * aInstanceOrbit.y + aInstanceOrbit.w;
+    vec3 orbitOffset = vec3(cos(orbitAngle), 0.0, sin(orbitAngle)) * aInstanceOrbit.x;
+    mat3 linear = axisRotation(aInstanceAxis.xyz, time * aInstanceOrbit.z) * mat3(aInstanceModel);
+    return mat4(vec4(linear[0], 0.0), vec4(linear[1], 0.0), vec4(linear[2], 0.0),
+                vec4(aInstanceModel[3].xyz + orbitOffset, 1.0));
+}
+)";
+
+// Собирается как "#version" + objectTransformSource + vertexShaderSource
+const char* vertexShaderSource = R"(
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aColor;
 layout (location = 4) in float aWeight;
+layout (location = 11) in vec2 aInstanceFlags;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 out vec3 VertexColor;
 out float Weight;
+flat out vec2 MaterialFlags;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Предварительный проход глубины и проход затенения сравнивают глубину на равенство
+invariant gl_Position;
+
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+uniform bool useVertexColor;
+uniform bool useGradient;
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    mat4 objectModel = ObjectModel();
+    FragPos = vec3(objectModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(objectModel))) * aNormal;
     TexCoords = aTexCoords;
     VertexColor = aColor;
     Weight = aWeight;
+    MaterialFlags = instanced ? aInstanceFlags : vec2(useVertexColor ? 1.0 : 0.0, useGradient ? 1.0 : 0.0);
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
 )";
 
-const char* fragmentShaderSource = R"(
-#version 330 core
-out vec4 FragColor;
-
+// Общая часть расчёта освещения для прямого рендеринга и для прохода освещения отложенного.
+// Точка поверхности задаётся через surfacePos и surfaceSpecular перед вызовом ShadeFragment
+const char* lightingCommonSource = R"(
 struct Material {
     sampler2D diffuse;
     sampler2D specular;
@@ -1131,73 +2742,142 @@ struct Material {
 
 struct DirLight {
     vec3 direction;
+    bool enabled;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
-    bool enabled;
 };
 
 struct PointLight {
     vec3 position;
     float constant;
-    float linear;
-    float quadratic;
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
     bool enabled;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
     float constant;
+    vec3 direction;
     float linear;
-    float quadratic;
     vec3 ambient;
+    float quadratic;
     vec3 diffuse;
+    float cutOff;
     vec3 specular;
+    float outerCutOff;
     bool enabled;
 };
 
-in vec3 FragPos;
-in vec3 Normal;
-in vec2 TexCoords;
-in vec3 VertexColor;
-in float Weight;
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLight;
+    SpotLight spotLight;
+};
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
 uniform Material material;
-uniform bool useVertexColor;
-uniform bool useGradient;
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color);
+uniform bool shadowsEnabled;
+uniform sampler2DArrayShadow dirShadowMap;
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 dirLightSpace[3];
+uniform vec3 cascadeSplits; // дальние границы каскадов по глубине вида
+uniform mat4 spotLightSpace;
+
+uniform bool clusteredLighting;
+uniform samplerBuffer clusterLights;   // 3 texel-а на источник: (позиция, радиус), (цвет, cos внешнего конуса или 0), (направление, cos внутреннего)
+uniform usamplerBuffer clusterGrid;    // (начало списка, число источников) на кластер
+uniform usamplerBuffer clusterIndices;
+uniform vec4 clusterScale;             // ширина и высота плитки, срезов на единицу log(depth / near), near
+uniform vec3 clusterDims;
+
+vec3 surfacePos;
+vec3 surfaceSpecular;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color, float shadow);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color, float shadow);
+
+// 3x3 выборки со сравнением, каждая из которых уже фильтруется 2x2
+float DirShadow(vec3 normal) {
+    float depth = -(view * vec4(surfacePos, 1.0)).z;
+    if (depth >= cascadeSplits.z) return 1.0;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : 2);
+
+    vec4 lightPos = dirLightSpace[cascade] * vec4(surfacePos + normal * 0.05 * float(cascade + 1), 1.0);
+    vec3 coords = lightPos.xyz * 0.5 + 0.5;
+    vec2 texel = 1.0 / vec2(textureSize(dirShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            lit += texture(dirShadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+        }
+    }
+    return lit / 9.0;
+}
 
-void main() {
-    vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-    
-    vec3 baseColor = useVertexColor ? VertexColor : texture(material.diffuse, TexCoords).rgb;
-    if (useGradient) {
-        baseColor *= Weight;
+vec3 CalcClusterLights(vec3 normal, vec3 viewDir, vec3 color) {
+    float depth = max(-(view * vec4(surfacePos, 1.0)).z, clusterScale.w);
+    ivec3 dims = ivec3(clusterDims);
+    ivec3 cell = ivec3(int(gl_FragCoord.x / clusterScale.x), int(gl_FragCoord.y / clusterScale.y),
+                       int(log(depth / clusterScale.w) * clusterScale.z));
+    cell = clamp(cell, ivec3(0), dims - 1);
+    uvec2 range = texelFetch(clusterGrid, (cell.z * dims.y + cell.y) * dims.x + cell.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(clusterLights, light * 3);
+        vec4 colorCone = texelFetch(clusterLights, light * 3 + 1);
+        vec4 directionCone = texelFetch(clusterLights, light * 3 + 2);
+
+        vec3 toLight = positionRadius.xyz - surfacePos;
+        float distance = length(toLight);
+        if (distance >= positionRadius.w) continue;
+        vec3 lightDir = toLight / distance;
+        float falloff = 1.0 - distance / positionRadius.w;
+        float attenuation = falloff * falloff;
+        if (colorCone.w > 0.0) {
+            float theta = dot(lightDir, -directionCone.xyz);
+            attenuation *= clamp((theta - colorCone.w) / max(directionCone.w - colorCone.w, 0.0001), 0.0, 1.0);
+        }
+
+        float diff = max(dot(normal, lightDir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), material.shininess);
+        result += attenuation * colorCone.rgb * (diff * color + spec * surfaceSpecular);
     }
-    
+    return result;
+}
+
+float SpotShadow(vec3 normal) {
+    vec4 lightPos = spotLightSpace * vec4(surfacePos + normal * 0.02, 1.0);
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (lightPos.w <= 0.0 || any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0)))) return 1.0;
+    return texture(spotShadowMap, coords);
+}
+
+vec3 ShadeFragment(vec3 norm, vec3 baseColor) {
+    vec3 viewDir = normalize(viewPos - surfacePos);
+
     vec3 result = vec3(0.0);
-    if (dirLight.enabled) result += CalcDirLight(dirLight, norm, viewDir, baseColor);
-    if (pointLight.enabled) result += CalcPointLight(pointLight, norm, FragPos, viewDir, baseColor);
-    if (spotLight.enabled) result += CalcSpotLight(spotLight, norm, FragPos, viewDir, baseColor);
-    
-    FragColor = vec4(result, 1.0);
+    if (dirLight.enabled) result += CalcDirLight(dirLight, norm, viewDir, baseColor, shadowsEnabled ? DirShadow(norm) : 1.0);
+    if (pointLight.enabled) result += CalcPointLight(pointLight, norm, surfacePos, viewDir, baseColor);
+    if (clusteredLighting) result += CalcClusterLights(norm, viewDir, baseColor);
+    if (spotLight.enabled) result += CalcSpotLight(spotLight, norm, surfacePos, viewDir, baseColor, shadowsEnabled ? SpotShadow(norm) : 1.0);
+    return result;
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color) {
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color, float shadow) {
     vec3 lightDir = normalize(-light.direction);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
@@ -1205,9 +2885,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color) {
     
     vec3 ambient = light.ambient * color;
     vec3 diffuse = light.diffuse * diff * color;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = light.specular * spec * surfaceSpecular;
     
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color) {
@@ -1221,7 +2901,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, v
     
     vec3 ambient = light.ambient * color;
     vec3 diffuse = light.diffuse * diff * color;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = light.specular * spec * surfaceSpecular;
     
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -1230,7 +2910,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, v
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color) {
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color, float shadow) {
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
@@ -1245,23 +2925,125 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec
     
     vec3 ambient = light.ambient * color;
     vec3 diffuse = light.diffuse * diff * color;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = light.specular * spec * surfaceSpecular;
     
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 )";
 
-const char* lightCubeShaderVS = R"(
-#version 330 core
-layout (location = 0) in vec3 aPos;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+const char* fragmentShaderSource = R"(
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in vec3 VertexColor;
+in float Weight;
+flat in vec2 MaterialFlags;
+
+uniform float opacity;
+
+void main() {
+    bool useVertexColor = MaterialFlags.x > 0.5;
+    bool useGradient = MaterialFlags.y > 0.5;
+
+    vec3 baseColor = useVertexColor ? VertexColor : texture(material.diffuse, TexCoords).rgb;
+    if (useGradient) {
+        baseColor *= Weight;
+    }
+
+    surfacePos = FragPos;
+    surfaceSpecular = texture(material.specular, TexCoords).rgb;
+    FragColor = vec4(ShadeFragment(normalize(Normal), baseColor), opacity);
+}
+)";
+
+// Отложенное освещение: геометрический проход пишет в G-буфер позицию, нормаль (w = 1 там, где есть геометрия),
+// альбедо и цвет блика, а полноэкранный проход считает освещение по одному разу на пиксель
+const char* gBufferShaderFS = R"(
+#version 330 core
+layout (location = 0) out vec4 gPosition;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gAlbedo;
+layout (location = 3) out vec4 gSpecular;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in vec3 VertexColor;
+in float Weight;
+flat in vec2 MaterialFlags;
+
+uniform Material material;
+
+void main() {
+    bool useVertexColor = MaterialFlags.x > 0.5;
+    bool useGradient = MaterialFlags.y > 0.5;
+
+    vec3 baseColor = useVertexColor ? VertexColor : texture(material.diffuse, TexCoords).rgb;
+    if (useGradient) {
+        baseColor *= Weight;
+    }
+
+    gPosition = vec4(FragPos, 1.0);
+    gNormal = vec4(normalize(Normal), 1.0);
+    gAlbedo = vec4(baseColor, 1.0);
+    gSpecular = vec4(texture(material.specular, TexCoords).rgb, 1.0);
+}
+)";
+
+// Один треугольник, накрывающий весь экран
+const char* fullscreenShaderVS = R"(
+#version 330 core
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* deferredLightingFS = R"(
+out vec4 FragColor;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 normal = texelFetch(gNormal, texel, 0);
+    if (normal.w == 0.0) discard;
+
+    surfacePos = texelFetch(gPosition, texel, 0).xyz;
+    surfaceSpecular = texelFetch(gSpecular, texel, 0).rgb;
+    // Глубина из G-буфера нужна следующим за освещением проходам (источник света)
+    gl_FragDepth = texelFetch(gDepth, texel, 0).r;
+    FragColor = vec4(ShadeFragment(normalize(normal.xyz), texelFetch(gAlbedo, texel, 0).rgb), 1.0);
+}
+)";
+
+const char* lightCubeShaderVS = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+uniform mat4 model;
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
@@ -1278,6 +3060,880 @@ void main() {
     FragColor = vec4(lightColor, 1.0);
 }
 )";
+// Собирается как "#version" + objectTransformSource + shadowDepthVS
+const char* shadowDepthVS = R"(
+uniform mat4 lightSpace;
+
+void main() {
+    gl_Position = lightSpace * ObjectModel() * vec4(aPos, 1.0);
+}
+)";
+const char* shadowDepthFS = R"(
+#version 330 core
+
+void main() {
+}
+)";
+
+// Кластерное прямое освещение: пирамида камеры делится на TILES_X x TILES_Y экранных плиток
+// и SLICES экспоненциальных срезов по глубине. Каждый кадр источники раскладываются по кластерам
+// на CPU, а списки уходят в texture buffer-ы: шейдер перебирает только источники своего кластера
+class ClusteredLights {
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTERS = TILES_X * TILES_Y * SLICES;
+    static const GLuint DATA_UNIT = 4;
+    static const GLuint GRID_UNIT = 5;
+    static const GLuint INDEX_UNIT = 6;
+
+    // Точечный источник или прожектор (spot) с радиусом действия; позиция и направление в мире
+    struct Light {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+        glm::vec3 direction;
+        float cosInner, cosOuter;
+        bool spot;
+    };
+
+    std::vector<Light> lights;
+
+    ClusteredLights() : nearPlane(CAMERA_NEAR), farPlane(CAMERA_FAR), tileWidth(1.0f), tileHeight(1.0f), maxPerCluster(0) {}
+
+    void init() {
+        dataBuffer = makeBuffer();
+        gridBuffer = makeBuffer();
+        indexBuffer = makeBuffer();
+        dataTexture = makeBufferTexture(dataBuffer.get(), GL_RGBA32F);
+        gridTexture = makeBufferTexture(gridBuffer.get(), GL_RG32UI);
+        indexTexture = makeBufferTexture(indexBuffer.get(), GL_R32UI);
+    }
+
+    void update(const glm::mat4& view, const glm::mat4& projection, int width, int height, float zNear, float zFar) {
+        nearPlane = zNear;
+        farPlane = zFar;
+        tileWidth = (float)width / TILES_X;
+        tileHeight = (float)height / TILES_Y;
+
+        // Два прохода: подсчёт источников в кластерах, префиксная сумма, затем заполнение списков
+        ranges.resize(lights.size());
+        counts.assign(CLUSTERS, 0);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            ranges[i] = clusterRange(lights[i], view, projection, width, height);
+            forEachCluster(ranges[i], [this](int cluster) { ++counts[cluster]; });
+        }
+
+        grid.resize(CLUSTERS * 2);
+        GLuint offset = 0;
+        maxPerCluster = 0;
+        for (int cluster = 0; cluster < CLUSTERS; ++cluster) {
+            grid[cluster * 2] = offset;
+            grid[cluster * 2 + 1] = 0;
+            offset += counts[cluster];
+            maxPerCluster = std::max(maxPerCluster, counts[cluster]);
+        }
+        indices.resize(std::max<GLuint>(offset, 1));
+        for (size_t i = 0; i < lights.size(); ++i) {
+            forEachCluster(ranges[i], [this, i](int cluster) {
+                indices[grid[cluster * 2] + grid[cluster * 2 + 1]++] = (GLuint)i;
+            });
+        }
+
+        data.resize(std::max<size_t>(lights.size(), 1) * 3);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            const Light& light = lights[i];
+            data[i * 3] = glm::vec4(light.position, light.radius);
+            data[i * 3 + 1] = glm::vec4(light.color, light.spot ? light.cosOuter : 0.0f);
+            data[i * 3 + 2] = glm::vec4(glm::normalize(light.direction), light.cosInner);
+        }
+
+        upload(dataBuffer.get(), data.data(), data.size() * sizeof(glm::vec4));
+        upload(gridBuffer.get(), grid.data(), grid.size() * sizeof(GLuint));
+        upload(indexBuffer.get(), indices.data(), indices.size() * sizeof(GLuint));
+    }
+
+    void bind(Shader& shader, bool enabled) const {
+        static const Shader::Handle enabledHandle = Shader::handle("clusteredLighting");
+        static const Shader::Handle dataHandle = Shader::handle("clusterLights");
+        static const Shader::Handle gridHandle = Shader::handle("clusterGrid");
+        static const Shader::Handle indexHandle = Shader::handle("clusterIndices");
+        static const Shader::Handle scaleHandle = Shader::handle("clusterScale");
+        static const Shader::Handle dimsHandle = Shader::handle("clusterDims");
+
+        shader.setInt(dataHandle, DATA_UNIT);
+        shader.setInt(gridHandle, GRID_UNIT);
+        shader.setInt(indexHandle, INDEX_UNIT);
+        shader.setBool(enabledHandle, enabled && dataTexture);
+        if (!enabled || !dataTexture) return;
+
+        glActiveTexture(GL_TEXTURE0 + DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, dataTexture.get());
+        glActiveTexture(GL_TEXTURE0 + GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture.get());
+        glActiveTexture(GL_TEXTURE0 + INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture.get());
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setVec4(scaleHandle, glm::vec4(tileWidth, tileHeight, SLICES / logf(farPlane / nearPlane), nearPlane));
+        shader.setVec3(dimsHandle, glm::vec3(TILES_X, TILES_Y, SLICES));
+    }
+
+    float averagePerCluster() const {
+        size_t total = 0;
+        for (GLuint count : counts) total += count;
+        return counts.empty() ? 0.0f : (float)total / counts.size();
+    }
+    GLuint maxLightsPerCluster() const { return maxPerCluster; }
+
+    void release() {
+        dataTexture.reset();
+        gridTexture.reset();
+        indexTexture.reset();
+        dataBuffer.reset();
+        gridBuffer.reset();
+        indexBuffer.reset();
+    }
+
+private:
+    // Включительные границы кластеров по x, y и срезу; пустой при x0 > x1
+    struct Range {
+        int x0, x1, y0, y1, z0, z1;
+    };
+
+    static GLTexture makeBufferTexture(GLuint buffer, GLenum format) {
+        // Пустой texture buffer недопустим: буфер сразу получает минимальный размер
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_BUFFER, id);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        return GLTexture(id);
+    }
+
+    static void upload(GLuint buffer, const void* source, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, source);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    int sliceOf(float depth) const {
+        int slice = (int)(logf(depth / nearPlane) * SLICES / logf(farPlane / nearPlane));
+        return std::min(std::max(slice, 0), SLICES - 1);
+    }
+
+    // Сфера действия источника (прожектор тоже берётся сферой) проецируется через углы её AABB
+    // в пространстве вида; сфера, задевающая ближнюю плоскость, занимает весь экран
+    Range clusterRange(const Light& light, const glm::mat4& view, const glm::mat4& projection, int width, int height) const {
+        Range range = {1, 0, 1, 0, 1, 0};
+        glm::vec3 center(view * glm::vec4(light.position, 1.0f));
+        float depth = -center.z;
+        if (depth + light.radius < nearPlane || depth - light.radius > farPlane) return range;
+
+        range.z0 = sliceOf(std::max(depth - light.radius, nearPlane));
+        range.z1 = sliceOf(std::min(depth + light.radius, farPlane));
+        range.x0 = 0;
+        range.x1 = TILES_X - 1;
+        range.y0 = 0;
+        range.y1 = TILES_Y - 1;
+        if (depth - light.radius <= nearPlane) return range;
+
+        glm::vec2 lo(1e9f), hi(-1e9f);
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 offset(corner & 1 ? light.radius : -light.radius, corner & 2 ? light.radius : -light.radius,
+                             corner & 4 ? light.radius : -light.radius);
+            glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f) return Range{1, 0, 1, 0, 1, 0};
+        range.x0 = std::max(0, (int)((lo.x * 0.5f + 0.5f) * width / tileWidth));
+        range.x1 = std::min(TILES_X - 1, (int)((hi.x * 0.5f + 0.5f) * width / tileWidth));
+        range.y0 = std::max(0, (int)((lo.y * 0.5f + 0.5f) * height / tileHeight));
+        range.y1 = std::min(TILES_Y - 1, (int)((hi.y * 0.5f + 0.5f) * height / tileHeight));
+        return range;
+    }
+
+    template <class Fn>
+    static void forEachCluster(const Range& range, Fn fn) {
+        for (int z = range.z0; z <= range.z1; ++z) {
+            for (int y = range.y0; y <= range.y1; ++y) {
+                for (int x = range.x0; x <= range.x1; ++x) fn((z * TILES_Y + y) * TILES_X + x);
+            }
+        }
+    }
+
+    float nearPlane, farPlane;
+    float tileWidth, tileHeight;
+    std::vector<Range> ranges;
+    std::vector<GLuint> counts;
+    std::vector<GLuint> grid;
+    std::vector<GLuint> indices;
+    std::vector<glm::vec4> data;
+    GLuint maxPerCluster;
+    GLBuffer dataBuffer, gridBuffer, indexBuffer;
+    GLTexture dataTexture, gridTexture, indexTexture;
+};
+
+// Карты теней: CASCADES каскадов направленного света в одном GL_TEXTURE_2D_ARRAY и
+// перспективная карта фонаря. Матрицы каскадов привязаны к сетке текселей против мерцания.
+// Каскады следуют за пирамидой камеры, а фонарь - за самой камерой, поэтому все карты
+// рисуются заново каждый кадр: неподвижные объекты (isStatic) обычными вызовами,
+// движущиеся - instanced из буфера InstancedRenderer
+class ShadowMaps {
+public:
+    static const int CASCADES = 3;
+    static const GLuint DIR_UNIT = 2;
+    static const GLuint SPOT_UNIT = 3;
+
+    ShadowMaps() : size(0) {
+        for (int i = 0; i < CASCADES; ++i) cascadeFar[i] = 0.0f;
+    }
+
+    void init(int mapSize) {
+        size = mapSize;
+        std::string vertexSource = std::string("#version 330 core\n") + objectTransformSource + shadowDepthVS;
+        depthShader.reset(new Shader(vertexSource.c_str(), shadowDepthFS, false));
+
+        dirMap = makeDepthTexture(GL_TEXTURE_2D_ARRAY, CASCADES);
+        spotMap = makeDepthTexture(GL_TEXTURE_2D, 1);
+
+        glGenFramebuffers(1, &drawFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFBO);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Матрицы и границы каскадов для текущей камеры.
+    // instances уже обновлён в этом кадре (InstancedRenderer::update с тем же gpuAnimation)
+    void render(std::vector<SceneObject>& objects, float totalTime, Camera& camera, float aspect, const LightsBlock& lights,
+                InstancedRenderer& instances, bool gpuAnimation, bool levelOfDetail) {
+        static const Shader::Handle gpuAnimationHandle = Shader::handle("gpuAnimation");
+        static const Shader::Handle timeHandle = Shader::handle("time");
+
+        if (!depthShader) return;
+
+        spheres.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) spheres[i] = objects[i].boundingSphere(totalTime);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        cameraPosition = camera.Position;
+        cameraPixelsPerUnit = levelOfDetail ? viewport[3] / (2.0f * tanf(glm::radians(camera.Zoom) * 0.5f)) : 0.0f;
+        glViewport(0, 0, size, size);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        depthShader->use();
+        depthShader->setBool(gpuAnimationHandle, gpuAnimation);
+        depthShader->setFloat(timeHandle, totalTime);
+
+        if (lights.dirLight.enabled) {
+            computeCascades(camera, aspect, lights.dirLight.direction);
+            for (int cascade = 0; cascade < CASCADES; ++cascade) {
+                renderMap(objects, instances, dirMap.get(), cascade, dirLightSpace[cascade]);
+            }
+        }
+        if (lights.spotLight.enabled) {
+            float fov = 2.0f * acosf(lights.spotLight.outerCutOff) + glm::radians(5.0f);
+            glm::mat4 view = glm::lookAt(lights.spotLight.position, lights.spotLight.position + lights.spotLight.direction, camera.Up);
+            spotLightSpace = glm::perspective(fov, 1.0f, 0.5f, 100.0f) * view;
+            renderMap(objects, instances, spotMap.get(), -1, spotLightSpace);
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    void bind(Shader& shader, bool enabled) const {
+        static const Shader::Handle enabledHandle = Shader::handle("shadowsEnabled");
+        static const Shader::Handle dirMapHandle = Shader::handle("dirShadowMap");
+        static const Shader::Handle spotMapHandle = Shader::handle("spotShadowMap");
+        static const Shader::Handle splitsHandle = Shader::handle("cascadeSplits");
+        static const Shader::Handle spotSpaceHandle = Shader::handle("spotLightSpace");
+        static const Shader::Handle dirSpaceHandles[CASCADES] = {
+            Shader::handle("dirLightSpace[0]"), Shader::handle("dirLightSpace[1]"), Shader::handle("dirLightSpace[2]")
+        };
+
+        // Сэмплеры разных типов не могут ссылаться на один блок, поэтому блоки задаются и без теней
+        shader.setInt(dirMapHandle, DIR_UNIT);
+        shader.setInt(spotMapHandle, SPOT_UNIT);
+        shader.setBool(enabledHandle, enabled && depthShader);
+        if (!enabled || !depthShader) return;
+
+        glActiveTexture(GL_TEXTURE0 + DIR_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, dirMap.get());
+        glActiveTexture(GL_TEXTURE0 + SPOT_UNIT);
+        glBindTexture(GL_TEXTURE_2D, spotMap.get());
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setVec3(splitsHandle, glm::vec3(cascadeFar[0], cascadeFar[1], cascadeFar[2]));
+        for (int i = 0; i < CASCADES; ++i) shader.setMat4(dirSpaceHandles[i], dirLightSpace[i]);
+        shader.setMat4(spotSpaceHandle, spotLightSpace);
+    }
+
+    void release() {
+        if (drawFBO) glDeleteFramebuffers(1, &drawFBO);
+        drawFBO = 0;
+        dirMap.reset();
+        spotMap.reset();
+        if (depthShader) glDeleteProgram(depthShader->ID);
+        depthShader.reset();
+        casterDraws.release();
+    }
+
+private:
+    // Дальность теней от камеры и запас глубины в сторону света для заслоняющих объектов
+    static constexpr float SHADOW_DISTANCE = 100.0f;
+    static constexpr float CASTER_EXTENT = 60.0f;
+
+    GLTexture makeDepthTexture(GLenum target, int layers) {
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(target, id);
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        } else {
+            glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        }
+        // Линейная фильтрация со сравнением даёт аппаратный PCF 2x2
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(target, 0);
+        return GLTexture(id);
+    }
+
+    // Каскад покрывает ограничивающую сферу своего участка пирамиды камеры. Радиус зависит только
+    // от границ участка и угла обзора, а центр округляется до текселя в пространстве света
+    void computeCascades(Camera& camera, float aspect, const glm::vec3& direction) {
+        const float nearPlane = CAMERA_NEAR;
+        const float lambda = 0.6f;
+        glm::vec3 lightDir = glm::normalize(direction);
+        glm::vec3 up = fabsf(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+        glm::mat4 view = camera.GetViewMatrix();
+
+        float sliceNear = nearPlane;
+        for (int cascade = 0; cascade < CASCADES; ++cascade) {
+            // Смесь логарифмического и равномерного разбиения
+            float t = (float)(cascade + 1) / CASCADES;
+            float logSplit = nearPlane * powf(SHADOW_DISTANCE / nearPlane, t);
+            float uniformSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * t;
+            float sliceFar = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+            cascadeFar[cascade] = sliceFar;
+
+            glm::mat4 inverseSlice = glm::inverse(glm::perspective(glm::radians(camera.Zoom), aspect, sliceNear, sliceFar) * view);
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int i = 0; i < 8; ++i) {
+                glm::vec4 corner = inverseSlice * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+                corners[i] = glm::vec3(corner) / corner.w;
+                center += corners[i];
+            }
+            center /= 8.0f;
+            float radius = 0.0f;
+            for (const auto& corner : corners) radius = std::max(radius, glm::length(corner - center));
+            radius = ceilf(radius * 16.0f) / 16.0f;
+
+            float texel = 2.0f * radius / size;
+            glm::vec3 lightCenter(lightView * glm::vec4(center, 1.0f));
+            lightCenter.x = floorf(lightCenter.x / texel) * texel;
+            lightCenter.y = floorf(lightCenter.y / texel) * texel;
+            lightCenter.z = floorf(lightCenter.z / texel) * texel;
+
+            glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                              lightCenter.y - radius, lightCenter.y + radius,
+                                              -(lightCenter.z + radius + CASTER_EXTENT), -(lightCenter.z - radius));
+            dirLightSpace[cascade] = projection * lightView;
+            sliceNear = sliceFar;
+        }
+    }
+
+    void attach(GLuint fbo, GLuint texture, int layer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        if (layer >= 0) glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        else glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    }
+
+    // Порог тот же, что у камеры, но без гистерезиса: object.lod этого кадра ещё не выбран
+    int casterLod(const SceneObject& object, const glm::vec4& sphere) const {
+        if (cameraPixelsPerUnit == 0.0f) return 0;
+        float distance = glm::length(glm::vec3(sphere) - cameraPosition);
+        return object.lodForScreenSize(distance > sphere.w ? 2.0f * sphere.w * cameraPixelsPerUnit / distance : 1e9f);
+    }
+
+    // Неподвижные объекты: по одному вызову на полном уровне детализации
+    void drawStaticCasters(std::vector<SceneObject>& objects, const glm::mat4& lightSpace) {
+        static const Shader::Handle instancedHandle = Shader::handle("instanced");
+        static const Shader::Handle modelHandle = Shader::handle("model");
+
+        Frustum frustum(lightSpace);
+        depthShader->setBool(instancedHandle, false);
+        for (size_t i = 0; i < objects.size(); ++i) {
+            SceneObject& object = objects[i];
+            if (!object.isStatic()) continue;
+            // У неподвижного объекта матрица от времени не зависит
+            glm::mat4 model = object.modelMatrix(0.0f);
+            if (!frustum.visible(object.mesh.bounds, model)) continue;
+            depthShader->setMat4(modelHandle, model);
+            object.mesh.DrawGeometry();
+        }
+    }
+
+    // Движущиеся объекты: выборка по ограничивающим сферам, экземпляры уже лежат в буфере
+    void drawMovingCasters(std::vector<SceneObject>& objects, InstancedRenderer& instances, const glm::mat4& lightSpace) {
+        static const Shader::Handle instancedHandle = Shader::handle("instanced");
+
+        Frustum frustum(lightSpace);
+        selection.assign(objects.size(), 0);
+        for (size_t i = 0; i < objects.size(); ++i) {
+            const SceneObject& object = objects[i];
+            if (object.isStatic()) continue;
+            if (object.mesh.bounds.valid && !frustum.visible(spheres[i])) continue;
+            selection[i] = (unsigned char)(casterLod(object, spheres[i]) + 1);
+        }
+        instances.select(casterDraws, &selection);
+        depthShader->setBool(instancedHandle, true);
+        instances.draw(*depthShader, casterDraws);
+    }
+
+    void renderMap(std::vector<SceneObject>& objects, InstancedRenderer& instances, GLuint target, int layer,
+                   const glm::mat4& lightSpace) {
+        static const Shader::Handle lightSpaceHandle = Shader::handle("lightSpace");
+
+        depthShader->setMat4(lightSpaceHandle, lightSpace);
+        attach(drawFBO, target, layer);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        drawStaticCasters(objects, lightSpace);
+        drawMovingCasters(objects, instances, lightSpace);
+    }
+
+    int size;
+    std::unique_ptr<Shader> depthShader;
+    GLTexture dirMap, spotMap;
+    GLuint drawFBO = 0;
+    std::vector<glm::vec4> spheres;
+    std::vector<unsigned char> selection;
+    InstancedRenderer::DrawList casterDraws;
+
+    glm::mat4 dirLightSpace[CASCADES];
+    float cascadeFar[CASCADES];
+    glm::mat4 spotLightSpace;
+    glm::vec3 cameraPosition;
+    float cameraPixelsPerUnit = 0.0f;
+};
+
+// Время прохода на GPU по запросам GL_TIME_ELAPSED. Запросы идут по кольцу, и результат читается
+// через несколько кадров, когда он уже готов, чтобы не останавливать конвейер
+class GpuTimer {
+public:
+    static const int QUERIES = 4;
+
+    GpuTimer() : next(0), lastMs(0.0f), averageMs(0.0f), samples(0) {
+        for (int i = 0; i < QUERIES; ++i) {
+            queries[i] = 0;
+            pending[i] = false;
+        }
+    }
+
+    void begin() {
+        if (!queries[0]) glGenQueries(QUERIES, queries);
+        // От старых запросов к новым; занятый слот для нового запроса дочитывается с ожиданием
+        for (int i = 0; i < QUERIES; ++i) {
+            int slot = (next + i) % QUERIES;
+            if (!pending[slot]) continue;
+            GLint available = 0;
+            if (i > 0) glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (i > 0 && !available) break;
+            collect(slot);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % QUERIES;
+    }
+
+    float last() const { return lastMs; }
+    float average() const { return averageMs; }
+    size_t sampleCount() const { return samples; }
+
+    void release() {
+        if (queries[0]) glDeleteQueries(QUERIES, queries);
+        for (int i = 0; i < QUERIES; ++i) {
+            queries[i] = 0;
+            pending[i] = false;
+        }
+    }
+
+private:
+    void collect(int slot) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        pending[slot] = false;
+        lastMs = elapsed / 1.0e6f;
+        averageMs = samples++ == 0 ? lastMs : averageMs * 0.9f + lastMs * 0.1f;
+    }
+
+    GLuint queries[QUERIES];
+    bool pending[QUERIES];
+    int next;
+    float lastMs, averageMs;
+    size_t samples;
+};
+
+// Профилировщик кадра: именованные участки с временем CPU (std::chrono) и, для участков с GPU-работой,
+// временем GPU через GpuTimer. По каждому участку хранится окно последних WINDOW кадров для min/avg/p99;
+// покадровые значения можно писать в CSV и в трассу формата Chrome (chrome://tracing, Perfetto).
+// GPU-участки не должны вкладываться друг в друга, а их значения приходят с задержкой в несколько кадров
+class Profiler {
+public:
+    static const int WINDOW = 240;
+
+    Profiler() : frameIndex(0), csvHeaderWritten(false), traceEvents(0), start(Clock::now()) {}
+
+    int scope(const std::string& name, bool gpu) {
+        for (size_t i = 0; i < scopes.size(); ++i) {
+            if (scopes[i].name == name) return (int)i;
+        }
+        scopes.emplace_back();
+        scopes.back().name = name;
+        scopes.back().gpu = gpu;
+        return (int)scopes.size() - 1;
+    }
+
+    bool openCsv(const std::string& path) {
+        csv.open(path);
+        if (!csv) std::cerr << "Failed to open profiler CSV: " << path << std::endl;
+        return (bool)csv;
+    }
+
+    bool openTrace(const std::string& path) {
+        trace.open(path);
+        if (!trace) {
+            std::cerr << "Failed to open profiler trace: " << path << std::endl;
+            return false;
+        }
+        trace << "[";
+        return true;
+    }
+
+    void beginFrame() { frameStart = Clock::now(); }
+
+    void begin(int id) {
+        Scope& scope = scopes[id];
+        scope.started = Clock::now();
+        if (scope.gpu) scope.timer.begin();
+    }
+
+    void end(int id) {
+        Scope& scope = scopes[id];
+        if (scope.gpu) scope.timer.end();
+        Clock::time_point now = Clock::now();
+        scope.frameCpu += milliseconds(scope.started, now);
+        scope.ran = true;
+        if (trace.is_open()) writeTraceEvent(scope.name, scope.started, now);
+    }
+
+    void endFrame() {
+        Clock::time_point now = Clock::now();
+        float frameMs = milliseconds(frameStart, now);
+        frame.push(frameMs);
+        if (trace.is_open()) writeTraceEvent("frame", frameStart, now);
+
+        for (Scope& scope : scopes) {
+            if (scope.ran) scope.cpu.push(scope.frameCpu);
+            // Новый результат запроса относится к одному из предыдущих кадров
+            scope.frameGpu = -1.0f;
+            if (scope.gpu && scope.timer.sampleCount() != scope.gpuSamples) {
+                scope.gpuSamples = scope.timer.sampleCount();
+                scope.frameGpu = scope.timer.last();
+                scope.gpuStats.push(scope.frameGpu);
+            }
+        }
+        if (csv.is_open()) writeCsvRow(frameMs);
+        if (trace.is_open()) writeGpuCounters(now);
+
+        for (Scope& scope : scopes) {
+            scope.frameCpu = 0.0f;
+            scope.ran = false;
+        }
+        ++frameIndex;
+    }
+
+    void report(std::ostream& out) const {
+        out << "\n=== Профиль за последние " << std::min<size_t>(frameIndex, WINDOW) << " кадров, мс (min / avg / p99) ===" << std::endl;
+        printRow(out, "frame", frame, nullptr);
+        for (const Scope& scope : scopes) {
+            if (scope.cpu.count == 0) continue;
+            printRow(out, scope.name, scope.cpu, scope.gpu ? &scope.gpuStats : nullptr);
+        }
+    }
+
+    // Короткая строка для заголовка окна
+    std::string summary() const {
+        std::ostringstream out;
+        out.precision(3);
+        out << "frame " << frame.average() << " ms";
+        for (const Scope& scope : scopes) {
+            if (scope.gpu && scope.gpuStats.count > 0) out << ", " << scope.name << " GPU " << scope.gpuStats.average();
+        }
+        return out.str();
+    }
+
+    void release() {
+        for (Scope& scope : scopes) scope.timer.release();
+        csv.close();
+        if (trace.is_open()) {
+            trace << "\n]\n";
+            trace.close();
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Кольцо последних значений
+    struct Window {
+        float values[WINDOW];
+        size_t count = 0;
+
+        void push(float value) { values[count++ % WINDOW] = value; }
+        size_t size() const { return std::min<size_t>(count, WINDOW); }
+
+        float average() const {
+            float sum = 0.0f;
+            for (size_t i = 0; i < size(); ++i) sum += values[i];
+            return size() ? sum / size() : 0.0f;
+        }
+
+        void stats(float& minimum, float& mean, float& p99) const {
+            std::vector<float> sorted(values, values + size());
+            std::sort(sorted.begin(), sorted.end());
+            minimum = sorted.empty() ? 0.0f : sorted.front();
+            mean = average();
+            p99 = sorted.empty() ? 0.0f : sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.99f))];
+        }
+    };
+
+    struct Scope {
+        std::string name;
+        bool gpu = false;
+        GpuTimer timer;
+        size_t gpuSamples = 0;
+        Clock::time_point started;
+        float frameCpu = 0.0f;
+        float frameGpu = -1.0f;
+        bool ran = false;
+        Window cpu, gpuStats;
+    };
+
+    static float milliseconds(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<float, std::milli>(to - from).count();
+    }
+
+    long long microseconds(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - start).count();
+    }
+
+    static void printRow(std::ostream& out, const std::string& name, const Window& cpu, const Window* gpu) {
+        float minimum, mean, p99;
+        cpu.stats(minimum, mean, p99);
+        out << "  " << name << ": CPU " << minimum << " / " << mean << " / " << p99;
+        if (gpu && gpu->count > 0) {
+            gpu->stats(minimum, mean, p99);
+            out << ", GPU " << minimum << " / " << mean << " / " << p99;
+        }
+        out << std::endl;
+    }
+
+    // Столбцы: номер кадра, время кадра, затем CPU и GPU каждого участка; пустая ячейка - участок не выполнялся
+    void writeCsvRow(float frameMs) {
+        if (!csvHeaderWritten) {
+            csv << "frame,frame_ms";
+            for (const Scope& scope : scopes) {
+                csv << "," << scope.name << "_cpu_ms";
+                if (scope.gpu) csv << "," << scope.name << "_gpu_ms";
+            }
+            csv << "\n";
+            csvHeaderWritten = true;
+        }
+        csv << frameIndex << "," << frameMs;
+        for (const Scope& scope : scopes) {
+            csv << ",";
+            if (scope.ran) csv << scope.frameCpu;
+            if (scope.gpu) {
+                csv << ",";
+                if (scope.frameGpu >= 0.0f) csv << scope.frameGpu;
+            }
+        }
+        csv << "\n";
+    }
+
+    void writeTraceEvent(const std::string& name, Clock::time_point from, Clock::time_point to) {
+        trace << (traceEvents++ ? ",\n" : "\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+              << ",\"ts\":" << microseconds(from) << ",\"dur\":" << microseconds(to) - microseconds(from) << "}";
+    }
+
+    // Время GPU не привязано к шкале CPU, поэтому пишется счётчиками
+    void writeGpuCounters(Clock::time_point now) {
+        for (const Scope& scope : scopes) {
+            if (scope.frameGpu < 0.0f) continue;
+            trace << (traceEvents++ ? ",\n" : "\n") << "{\"name\":\"" << scope.name << " GPU ms\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+                  << microseconds(now) << ",\"args\":{\"ms\":" << scope.frameGpu << "}}";
+        }
+    }
+
+    std::vector<Scope> scopes;
+    Window frame;
+    size_t frameIndex;
+    std::ofstream csv;
+    bool csvHeaderWritten;
+    std::ofstream trace;
+    size_t traceEvents;
+    Clock::time_point start, frameStart;
+};
+
+Profiler profiler;
+
+// G-буфер отложенного освещения и его полноэкранный проход. Текстуры пересоздаются при смене размера окна
+class GBuffer {
+public:
+    static const int TARGETS = 4;
+    // Позиция, нормаль, альбедо, блик и глубина идут на блоки подряд, после кластерного освещения
+    static const GLuint FIRST_UNIT = 7;
+
+    GBuffer() : width(0), height(0) {}
+
+    bool init() {
+        std::string geometrySource = std::string("#version 330 core\n") + objectTransformSource + vertexShaderSource;
+        geometryShader.reset(new Shader(geometrySource.c_str(), gBufferShaderFS, false));
+        std::string lightingSource = std::string("#version 330 core\n") + lightingCommonSource + deferredLightingFS;
+        lightingShader.reset(new Shader(fullscreenShaderVS, lightingSource.c_str(), false));
+        if (geometryShader->ID == 0 || lightingShader->ID == 0) return false;
+
+        geometryShader->bindUniformBlock("Matrices", SceneUniforms::MATRICES_BINDING);
+        lightingShader->bindUniformBlock("Matrices", SceneUniforms::MATRICES_BINDING);
+        lightingShader->bindUniformBlock("Lights", SceneUniforms::LIGHTS_BINDING);
+
+        const char* samplers[TARGETS + 1] = { "gPosition", "gNormal", "gAlbedo", "gSpecular", "gDepth" };
+        lightingShader->use();
+        lightingShader->setFloat("material.shininess", 64.0f);
+        for (int i = 0; i <= TARGETS; ++i) lightingShader->setInt(samplers[i], FIRST_UNIT + i);
+
+        GLuint id = 0;
+        glGenVertexArrays(1, &id);
+        emptyVAO.reset(id);
+        glGenFramebuffers(1, &fbo);
+        return true;
+    }
+
+    void resize(int w, int h) {
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+
+        // Позиция во float32: в half на расстоянии сотни единиц шаг уже заметен в тенях и бликах
+        targets[0] = makeTarget(GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        targets[1] = makeTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        targets[2] = makeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        targets[3] = makeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        depth = makeTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        GLenum drawBuffers[TARGETS];
+        for (int i = 0; i < TARGETS; ++i) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, targets[i].get(), 0);
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth.get(), 0);
+        glDrawBuffers(TARGETS, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "G-buffer framebuffer is incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+    }
+
+    Shader& geometry() { return *geometryShader; }
+
+    void beginGeometry() {
+        static const GLfloat empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        static const GLfloat farDepth = 1.0f;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        for (int i = 0; i < TARGETS; ++i) glClearBufferfv(GL_COLOR, i, empty);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+        geometryShader->use();
+    }
+
+    // Освещение в выходной кадровый буфер; пиксели без геометрии отбрасываются и сохраняют фон
+    void light(const ShadowMaps& shadows, bool shadowsOn, const ClusteredLights& clusters, bool clustersOn) {
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        lightingShader->use();
+        shadows.bind(*lightingShader, shadowsOn);
+        clusters.bind(*lightingShader, clustersOn);
+
+        for (int i = 0; i < TARGETS; ++i) {
+            glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, targets[i].get());
+        }
+        glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + TARGETS);
+        glBindTexture(GL_TEXTURE_2D, depth.get());
+        glActiveTexture(GL_TEXTURE0);
+
+        glDepthFunc(GL_ALWAYS);
+        bindVertexArray(emptyVAO.get());
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glDepthFunc(GL_LESS);
+    }
+
+    void release() {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+        for (GLTexture& target : targets) target.reset();
+        depth.reset();
+        emptyVAO.reset();
+        if (geometryShader) glDeleteProgram(geometryShader->ID);
+        if (lightingShader) glDeleteProgram(lightingShader->ID);
+        geometryShader.reset();
+        lightingShader.reset();
+        width = height = 0;
+    }
+
+private:
+    GLTexture makeTarget(GLint internalFormat, GLenum format, GLenum type) {
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return GLTexture(id);
+    }
+
+    int width, height;
+    std::unique_ptr<Shader> geometryShader, lightingShader;
+    GLTexture targets[TARGETS];
+    GLTexture depth;
+    GLVertexArray emptyVAO;
+    GLuint fbo = 0;
+};
+
 
 namespace Software2D {
 
@@ -1329,88 +3985,323 @@ public:
     }
 };
 
-class BaseShader {
-public:
-    virtual ~BaseShader() = default;
-    virtual COLOR getColor(float x, float y, float h0, float h1, float h2) = 0;
+// Шейдеры без виртуальных вызовов: DrawTriangle инстанцируется для каждого типа.
+// Inputs перечисляет, от чего зависит цвет; всё остальное считается в конструкторе
+// один раз на треугольник, а при Inputs == 0 растеризатор пишет готовый цвет
+enum ShaderInput : unsigned {
+    SHADE_X = 1, SHADE_Y = 2, SHADE_H0 = 4, SHADE_H1 = 8, SHADE_H2 = 16
 };
 
-class PulseShader : public BaseShader {
-    float t, a; COLOR c;
+class PulseShader {
+    COLOR color;
 public:
-    PulseShader(COLOR col, float time, float alpha) : c(col), t(time), a(alpha) {}
-    COLOR getColor(float, float, float, float, float) override {
+    static const unsigned Inputs = 0;
+    PulseShader(COLOR c, float t, float a) {
         float p = sin(t * 3) * 0.3f + 0.7f;
-        return COLOR(c.r * p, c.g * p, c.b * p, c.a * a);
+        color = COLOR(c.r * p, c.g * p, c.b * p, c.a * a);
     }
+    COLOR constantColor() const { return color; }
+    COLOR getColor(float, float, float, float, float) const { return color; }
 };
-class WaveShader : public BaseShader {
-    float t, a; COLOR c;
+class WaveShader {
+    float t2, a; COLOR c;
 public:
-    WaveShader(COLOR col, float time, float alpha) : c(col), t(time), a(alpha) {}
-    COLOR getColor(float x, float, float, float, float) override {
-        float w = sin(x * 0.05f + t * 2) * 0.3f + 0.7f;
+    static const unsigned Inputs = SHADE_X;
+    WaveShader(COLOR col, float time, float alpha) : t2(time * 2), a(alpha), c(col) {}
+    COLOR getColor(float x, float, float, float, float) const {
+        float w = sin(x * 0.05f + t2) * 0.3f + 0.7f;
         return COLOR(c.r * w, c.g * w, c.b * w, c.a * a);
     }
 };
-class FloodShader : public BaseShader {
-    float t, a; COLOR c;
-public:
-    FloodShader(COLOR col, float time, float alpha) : c(col), t(time), a(alpha) {}
-    COLOR getColor(float, float, float, float h1, float) override {
-        float lvl = sin(t * 1.5f) * 0.3f + 0.5f;
-        return (h1 < lvl) ? COLOR(c.r*0.7f, c.g*0.7f, c.b*0.7f, c.a*a*0.8f) : COLOR(c.r, c.g, c.b, c.a*a);
+class FloodShader {
+    float lvl; COLOR below, above;
+public:
+    static const unsigned Inputs = SHADE_H1;
+    FloodShader(COLOR c, float t, float a) :
+        lvl(sin(t * 1.5f) * 0.3f + 0.5f),
+        below(c.r*0.7f, c.g*0.7f, c.b*0.7f, c.a*a*0.8f), above(c.r, c.g, c.b, c.a*a) {}
+    COLOR getColor(float, float, float, float h1, float) const { return (h1 < lvl) ? below : above; }
+};
+class FlickerShader {
+    float t8, a; COLOR c;
+public:
+    static const unsigned Inputs = SHADE_X;
+    FlickerShader(COLOR col, float time, float alpha) : t8(time * 8), a(alpha), c(col) {}
+    COLOR getColor(float x, float, float, float, float) const {
+        float f = sin(t8 + x * 0.1f) * 0.2f + 0.8f;
+        return COLOR(c.r * f, c.g * f, c.b * f, c.a * a);
+    }
+};
+class GradientShader {
+    float a; COLOR c;
+public:
+    static const unsigned Inputs = SHADE_H0 | SHADE_H1 | SHADE_H2;
+    GradientShader(COLOR col, float, float alpha) : a(alpha), c(col) {}
+    COLOR getColor(float, float, float h0, float h1, float h2) const {
+        float g = (h0 + h1 * 0.5f + h2 * 0.5f) / 1.5f;
+        return COLOR(c.r * g, c.g * g, c.b * g, c.a * a);
+    }
+};
+class HoleShader {
+    COLOR c;
+public:
+    static const unsigned Inputs = 0;
+    HoleShader(COLOR col) : c(col) {}
+    COLOR constantColor() const { return c; }
+    COLOR getColor(float, float, float, float, float) const { return c; }
+};
+
+// Пул потоков растеризатора: parallelFor раздаёт индексы [0, count) через атомарный счётчик,
+// вызывающий поток работает наравне с остальными и возвращается, когда все задачи выполнены
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned int threads) : task(nullptr), taskCount(0), next(0), busy(0), generation(0), stopping(false) {
+        for (unsigned int i = 0; i < threads; ++i) workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void parallelFor(int count, const std::function<void(int)>& fn) {
+        if (workers.empty() || count <= 1) {
+            for (int i = 0; i < count; ++i) fn(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &fn;
+            taskCount = count;
+            next = 0;
+            busy = (int)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        runTasks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        task = nullptr;
+    }
+
+    unsigned int threads() const { return (unsigned int)workers.size() + 1; }
+
+private:
+    void workerLoop() {
+        unsigned int seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            runTasks();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    void runTasks() {
+        for (int i = next++; i < taskCount; i = next++) (*task)(i);
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int)>* task;
+    int taskCount;
+    std::atomic<int> next;
+    int busy;
+    unsigned int generation;
+    bool stopping;
+};
+
+// Вариант внутреннего цикла растеризатора; все три дают одинаковый результат
+enum class RasterBackend { Scalar, SSE, AVX2 };
+
+inline RasterBackend DetectRasterBackend() {
+#ifdef SOFTWARE2D_X86_SIMD
+    if (SDL_HasAVX2()) return RasterBackend::AVX2;
+    if (SDL_HasSSE2()) return RasterBackend::SSE;
+#endif
+    return RasterBackend::Scalar;
+}
+
+inline const char* RasterBackendName(RasterBackend backend) {
+    switch (backend) {
+        case RasterBackend::AVX2: return "AVX2";
+        case RasterBackend::SSE: return "SSE";
+        default: return "scalar";
     }
-};
-class FlickerShader : public BaseShader {
-    float t, a; COLOR c;
-public:
-    FlickerShader(COLOR col, float time, float alpha) : c(col), t(time), a(alpha) {}
-    COLOR getColor(float x, float, float, float, float) override {
-        float f = sin(t * 8 + x * 0.1f) * 0.2f + 0.8f;
-        return COLOR(c.r * f, c.g * f, c.b * f, c.a * a);
+}
+
+// Прямоугольник пикселей [x0, x1) x [y0, y1)
+struct Rect {
+    int x0, y0, x1, y1;
+    Rect() : x0(0), y0(0), x1(0), y1(0) {}
+    Rect(int left, int top, int right, int bottom) : x0(left), y0(top), x1(right), y1(bottom) {}
+
+    bool Empty() const { return x0 >= x1 || y0 >= y1; }
+    int Width() const { return x1 - x0; }
+    int Height() const { return y1 - y0; }
+    int Area() const { return Empty() ? 0 : Width() * Height(); }
+
+    Rect Union(const Rect& o) const {
+        if (Empty()) return o;
+        if (o.Empty()) return *this;
+        return Rect(std::min(x0, o.x0), std::min(y0, o.y0), std::max(x1, o.x1), std::max(y1, o.y1));
     }
-};
-class GradientShader : public BaseShader {
-    float t, a; COLOR c;
-public:
-    GradientShader(COLOR col, float time, float alpha) : c(col), t(time), a(alpha) {}
-    COLOR getColor(float, float, float h0, float h1, float h2) override {
-        float g = (h0 + h1 * 0.5f + h2 * 0.5f) / 1.5f;
-        return COLOR(c.r * g, c.g * g, c.b * g, c.a * a);
+    Rect Intersect(const Rect& o) const {
+        return Rect(std::max(x0, o.x0), std::max(y0, o.y0), std::min(x1, o.x1), std::min(y1, o.y1));
     }
 };
-class HoleShader : public BaseShader {
-    COLOR c;
-public:
-    HoleShader(COLOR col) : c(col) {}
-    COLOR getColor(float, float, float, float, float) override { return c; }
-};
 
 class Frame {
     int width, height;
 public:
+    static const int TILE_SIZE = 64;
+
     std::vector<COLOR> pixels;
-    Frame(int w, int h) : width(w), height(h), pixels(w * h) {}
+    Frame(int w, int h) : width(w), height(h), pixels(w * h),
+        tilesX((w + TILE_SIZE - 1) / TILE_SIZE), tilesY((h + TILE_SIZE - 1) / TILE_SIZE),
+        pool(nullptr), clearPending(false), backend(DetectRasterBackend()), cleared(false) {}
     
     const void* getData() const { return pixels.data(); }
 
+    void SetBackend(RasterBackend rasterBackend) { backend = rasterBackend; }
+    RasterBackend Backend() const { return backend; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // С пулом треугольники раскладываются по тайлам 64x64 и закрашиваются в Flush параллельно.
+    // Внутри тайла порядок треугольников сохраняется, поэтому результат совпадает с последовательным
+    void SetTiled(WorkerPool* workerPool) {
+        Flush();
+        pool = workerPool;
+        bins.assign(pool ? tilesX * tilesY : 0, std::vector<int>());
+    }
+    bool Tiled() const { return pool != nullptr; }
+
+    void Flush() {
+        if (!pool || (!clearPending && triangles.empty())) return;
+
+        pool->parallelFor(tilesX * tilesY, [this](int tile) {
+            int tx = tile % tilesX, ty = tile / tilesX;
+            int sx = tx * TILE_SIZE, sy = ty * TILE_SIZE;
+            int ex = std::min(width, sx + TILE_SIZE) - 1, ey = std::min(height, sy + TILE_SIZE) - 1;
+            if (clearPending) {
+                Rect tileRect(sx, sy, ex + 1, ey + 1);
+                for (const Rect& region : clearRects) FillRect(region.Intersect(tileRect), clearColor);
+            }
+            for (int index : bins[tile]) triangles[index](*this, sx, sy, ex, ey);
+        });
+
+        for (auto& bin : bins) bin.clear();
+        triangles.clear();
+        clearRects.clear();
+        clearPending = false;
+    }
+
+    // Области, изменённые с прошлого вызова (рисование и очистка), одним объемлющим прямоугольником:
+    // только его и нужно отправлять в текстуру
+    Rect TakeChangedRect() {
+        Rect result = changed;
+        changed = Rect();
+        return result;
+    }
+
+    // Объемлющий прямоугольник всего нарисованного после последней очистки
+    Rect DrawnBounds() const {
+        Rect result;
+        for (const Rect& region : drawnRects) result = result.Union(region);
+        return result;
+    }
+    bool Cleared() const { return cleared; }
+    COLOR ClearColor() const { return clearColor; }
+
+    // Для записи в pixels в обход SetPixel/DrawTriangle
+    void MarkDirty(const Rect& rect) {
+        Rect r = rect.Intersect(Rect(0, 0, width, height));
+        if (r.Empty()) return;
+        changed = changed.Union(r);
+        // Пересекающиеся области сливаются, чтобы очистка не проходила пиксели дважды
+        for (size_t i = 0; i < drawnRects.size();) {
+            if (!drawnRects[i].Intersect(r).Empty()) {
+                r = r.Union(drawnRects[i]);
+                drawnRects[i] = drawnRects.back();
+                drawnRects.pop_back();
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+        drawnRects.push_back(r);
+    }
+
+    // Смешивание в 8-битной фиксированной точке: (x + 128) * 257 >> 16 ~ x / 255 с округлением,
+    // при a == 255 результат совпадает с копированием
+    static Uint8 Blend8(int s, int d, int a) {
+        return (Uint8)(((a * s + (255 - a) * d + 128) * 257) >> 16);
+    }
+
+    static void BlendPixel(COLOR& d, COLOR s) {
+        d = COLOR(Blend8(s.r, d.r, s.a), Blend8(s.g, d.g, s.a), Blend8(s.b, d.b, s.a), 255);
+    }
+
     void SetPixel(int x, int y, COLOR color) {
         if (x >= 0 && x < width && y >= 0 && y < height) {
-            if (color.a == 255) pixels[y * width + x] = color;
-            else {
-                COLOR d = pixels[y * width + x];
-                float a = color.a / 255.0f, ia = 1.0f - a;
-                pixels[y * width + x] = {
-                    (Uint8)(color.r * a + d.r * ia), (Uint8)(color.g * a + d.g * ia), (Uint8)(color.b * a + d.b * ia), 255
-                };
-            }
+            BlendPixel(pixels[y * width + x], color);
+            MarkDirty(Rect(x, y, x + 1, y + 1));
+        }
+    }
+
+    // Запись без проверки границ для растеризатора, который уже обрезал ограничивающий прямоугольник
+    COLOR* Row(int y) { return &pixels[y * width]; }
+
+    // Отрезок строки одним цветом; грязную область отмечает вызывающий (DrawTriangle - до раскладки по тайлам)
+    void BlendSpanUnchecked(int x, int y, int count, COLOR color) {
+        COLOR* dst = Row(y) + x;
+        if (color.a == 255) {
+            std::fill(dst, dst + count, color);
+            return;
+        }
+        for (int i = 0; i < count; i++) BlendPixel(dst[i], color);
+    }
+    // Повторная очистка тем же цветом затрагивает только то, что было нарисовано после прошлой
+    void Clear(COLOR color) {
+        bool sameColor = cleared && color.r == clearColor.r && color.g == clearColor.g &&
+                         color.b == clearColor.b && color.a == clearColor.a;
+        std::vector<Rect> regions;
+        if (sameColor) regions.swap(drawnRects);
+        else regions.push_back(Rect(0, 0, width, height));
+        for (const Rect& region : regions) changed = changed.Union(region);
+        drawnRects.clear();
+        cleared = true;
+        clearColor = color;
+
+        if (pool) {
+            // Отложенная очистка перекрывает всё, что было разложено по тайлам до неё
+            for (auto& bin : bins) bin.clear();
+            triangles.clear();
+            if (clearPending && sameColor) regions.insert(regions.end(), clearRects.begin(), clearRects.end());
+            clearRects.swap(regions);
+            clearPending = true;
+            return;
         }
+        for (const Rect& region : regions) FillRect(region, color);
     }
-    void Clear(COLOR color) { std::fill(pixels.begin(), pixels.end(), color); }
 
     template <class ShaderT>
-    void DrawTriangle(float x0, float y0, float x1, float y1, float x2, float y2, ShaderT&& shader) {
+    void DrawTriangle(float x0, float y0, float x1, float y1, float x2, float y2, const ShaderT& shader) {
 
         float minX = std::min(x0, std::min(x1, x2));
         float maxX = std::max(x0, std::max(x1, x2));
@@ -1419,18 +4310,250 @@ public:
         
         int sx = std::max(0, (int)minX), ex = std::min(width - 1, (int)maxX);
         int sy = std::max(0, (int)minY), ey = std::min(height - 1, (int)maxY);
+        if (sx > ex || sy > ey) return;
+        MarkDirty(Rect(sx, sy, ex + 1, ey + 1));
+
+        if (!pool) {
+            RasterizeTriangle(x0, y0, x1, y1, x2, y2, shader, sx, sy, ex, ey);
+            return;
+        }
+
+        int index = (int)triangles.size();
+        ShaderT shaderCopy(shader);
+        triangles.push_back([=](Frame& frame, int tsx, int tsy, int tex, int tey) {
+            frame.RasterizeTriangle(x0, y0, x1, y1, x2, y2, shaderCopy,
+                                    std::max(sx, tsx), std::max(sy, tsy), std::min(ex, tex), std::min(ey, tey));
+        });
+        for (int ty = sy / TILE_SIZE; ty <= ey / TILE_SIZE; ty++) {
+            for (int tx = sx / TILE_SIZE; tx <= ex / TILE_SIZE; tx++) bins[ty * tilesX + tx].push_back(index);
+        }
+    }
+
+private:
+    void FillRect(const Rect& rect, COLOR color) {
+        if (rect.Empty()) return;
+        for (int y = rect.y0; y < rect.y1; y++) std::fill(Row(y) + rect.x0, Row(y) + rect.x1, color);
+    }
+
+    template <class ShaderT>
+    void RasterizeTriangle(float x0, float y0, float x1, float y1, float x2, float y2, const ShaderT& shader,
+                           int sx, int sy, int ex, int ey) {
         float S = (y1 - y2) * (x0 - x2) + (x2 - x1) * (y0 - y2);
+        if (S == 0.0f) return;
+
+        // Барицентрические веса линейны: h = a * px + b * py, 1/S внесён в коэффициенты.
+        // Слагаемое по y считается один раз на строку, px - от координаты пикселя,
+        // а не накоплением, поэтому тайлы и SIMD-дорожки совпадают бит в бит
+        float invS = 1.0f / S;
+        EdgeSetup e = {x2, y2, (y1 - y2) * invS, (x2 - x1) * invS, (y2 - y0) * invS, (x0 - x2) * invS};
+
+        // Постоянный цвет не зависит от пикселя: покрытые пиксели строки собираются в отрезки,
+        // и каждый отрезок заливается целиком (при a == 255 - простым копированием)
+        if constexpr (ShaderT::Inputs == 0) {
+            COLOR color = shader.constantColor();
+            for (int y = sy; y <= ey; y++) {
+                float r0 = e.b0 * (y + 0.5f - e.y2);
+                float r1 = e.b1 * (y + 0.5f - e.y2);
+                auto covered = [&](int x) {
+                    float px = x + 0.5f - e.x2;
+                    float h0 = e.a0 * px + r0;
+                    float h1 = e.a1 * px + r1;
+                    return h0 >= -1e-6f && h1 >= -1e-6f && 1.0f - h0 - h1 >= -1e-6f;
+                };
+                for (int x = sx; x <= ex;) {
+                    if (!covered(x)) {
+                        x++;
+                        continue;
+                    }
+                    int start = x;
+                    while (x <= ex && covered(x)) x++;
+                    BlendSpanUnchecked(start, y, x - start, color);
+                }
+            }
+            return;
+        }
 
+#ifdef SOFTWARE2D_X86_SIMD
+        if (backend == RasterBackend::AVX2) {
+            RasterizeAVX2(e, shader, sx, sy, ex, ey);
+            return;
+        }
+        if (backend == RasterBackend::SSE) {
+            RasterizeSSE(e, shader, sx, sy, ex, ey);
+            return;
+        }
+#endif
         for (int y = sy; y <= ey; y++) {
+            float r0 = e.b0 * (y + 0.5f - e.y2);
+            float r1 = e.b1 * (y + 0.5f - e.y2);
             for (int x = sx; x <= ex; x++) {
-                float h0 = ((y1 - y2) * (x + 0.5f - x2) + (x2 - x1) * (y + 0.5f - y2)) / S;
-                float h1 = ((y2 - y0) * (x + 0.5f - x2) + (x0 - x2) * (y + 0.5f - y2)) / S;
+                float px = x + 0.5f - e.x2;
+                float h0 = e.a0 * px + r0;
+                float h1 = e.a1 * px + r1;
                 float h2 = 1.0f - h0 - h1;
-                if (h0 >= -1e-6f && h1 >= -1e-6f && h2 >= -1e-6f)
-                    SetPixel(x, y, shader.getColor(x + 0.5f, y + 0.5f, h0, h1, h2));
+                if (h0 >= -1e-6f && h1 >= -1e-6f && h2 >= -1e-6f) ShadePixel(x, y, h0, h1, h2, shader);
+            }
+        }
+    }
+
+    struct EdgeSetup {
+        float x2, y2;
+        float a0, b0;
+        float a1, b1;
+    };
+
+    template <class ShaderT>
+    static COLOR ShadeColor(int x, int y, float h0, float h1, float h2, const ShaderT& shader) {
+        if constexpr (ShaderT::Inputs == 0) return shader.constantColor();
+        else return shader.getColor(x + 0.5f, y + 0.5f, h0, h1, h2);
+    }
+
+    template <class ShaderT>
+    void ShadePixel(int x, int y, float h0, float h1, float h2, const ShaderT& shader) {
+        BlendPixel(Row(y)[x], ShadeColor(x, y, h0, h1, h2, shader));
+    }
+
+    // Маска покрытия считается для N = 4/8 пикселей сразу, шейдер вызывается только для покрытых.
+    // Полная группа смешивается одним SIMD-проходом с маской; хвост строки (он может
+    // граничить с соседним тайлом) пишется попиксельно
+    template <int N, class ShaderT>
+    void ShadeLanes(int x, int y, int bits, bool fullGroup, const float* h0, const float* h1, const float* h2, const ShaderT& shader) {
+        COLOR* dst = Row(y) + x;
+        if (!fullGroup) {
+            while (bits) {
+                int lane = __builtin_ctz(bits);
+                bits &= bits - 1;
+                BlendPixel(dst[lane], ShadeColor(x + lane, y, h0[lane], h1[lane], h2[lane], shader));
+            }
+            return;
+        }
+
+        COLOR colors[N];
+        for (int lane = 0; lane < N; lane++) {
+            if (bits & (1 << lane)) colors[lane] = ShadeColor(x + lane, y, h0[lane], h1[lane], h2[lane], shader);
+        }
+#ifdef SOFTWARE2D_X86_SIMD
+        if constexpr (N == 8) BlendLanesAVX2(dst, colors, bits);
+        else BlendLanesSSE(dst, colors, bits);
+#endif
+    }
+
+#ifdef SOFTWARE2D_X86_SIMD
+    template <class ShaderT>
+    __attribute__((target("sse2")))
+    void RasterizeSSE(const EdgeSetup& e, const ShaderT& shader, int sx, int sy, int ex, int ey) {
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 x2 = _mm_set1_ps(e.x2), a0 = _mm_set1_ps(e.a0), a1 = _mm_set1_ps(e.a1);
+        const __m128 one = _mm_set1_ps(1.0f), eps = _mm_set1_ps(-1e-6f);
+        alignas(16) float h0s[4], h1s[4], h2s[4];
+
+        for (int y = sy; y <= ey; y++) {
+            const __m128 r0 = _mm_set1_ps(e.b0 * (y + 0.5f - e.y2));
+            const __m128 r1 = _mm_set1_ps(e.b1 * (y + 0.5f - e.y2));
+            for (int x = sx; x <= ex; x += 4) {
+                __m128 px = _mm_sub_ps(_mm_add_ps(_mm_set1_ps((float)x), laneOffsets), x2);
+                __m128 h0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+                __m128 h1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+                __m128 h2 = _mm_sub_ps(_mm_sub_ps(one, h0), h1);
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(h0, eps), _mm_and_ps(_mm_cmpge_ps(h1, eps), _mm_cmpge_ps(h2, eps)));
+                int bits = _mm_movemask_ps(inside);
+                bool fullGroup = ex - x >= 3;
+                if (!fullGroup) bits &= (1 << (ex - x + 1)) - 1;
+                if (!bits) continue;
+                _mm_store_ps(h0s, h0);
+                _mm_store_ps(h1s, h1);
+                _mm_store_ps(h2s, h2);
+                ShadeLanes<4>(x, y, bits, fullGroup, h0s, h1s, h2s, shader);
+            }
+        }
+    }
+
+    template <class ShaderT>
+    __attribute__((target("avx2")))
+    void RasterizeAVX2(const EdgeSetup& e, const ShaderT& shader, int sx, int sy, int ex, int ey) {
+        const __m256 laneOffsets = _mm256_set_ps(7.5f, 6.5f, 5.5f, 4.5f, 3.5f, 2.5f, 1.5f, 0.5f);
+        const __m256 x2 = _mm256_set1_ps(e.x2), a0 = _mm256_set1_ps(e.a0), a1 = _mm256_set1_ps(e.a1);
+        const __m256 one = _mm256_set1_ps(1.0f), eps = _mm256_set1_ps(-1e-6f);
+        alignas(32) float h0s[8], h1s[8], h2s[8];
+
+        for (int y = sy; y <= ey; y++) {
+            const __m256 r0 = _mm256_set1_ps(e.b0 * (y + 0.5f - e.y2));
+            const __m256 r1 = _mm256_set1_ps(e.b1 * (y + 0.5f - e.y2));
+            for (int x = sx; x <= ex; x += 8) {
+                __m256 px = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps((float)x), laneOffsets), x2);
+                __m256 h0 = _mm256_add_ps(_mm256_mul_ps(a0, px), r0);
+                __m256 h1 = _mm256_add_ps(_mm256_mul_ps(a1, px), r1);
+                __m256 h2 = _mm256_sub_ps(_mm256_sub_ps(one, h0), h1);
+                __m256 inside = _mm256_and_ps(_mm256_cmp_ps(h0, eps, _CMP_GE_OQ),
+                                              _mm256_and_ps(_mm256_cmp_ps(h1, eps, _CMP_GE_OQ), _mm256_cmp_ps(h2, eps, _CMP_GE_OQ)));
+                int bits = _mm256_movemask_ps(inside);
+                bool fullGroup = ex - x >= 7;
+                if (!fullGroup) bits &= (1 << (ex - x + 1)) - 1;
+                if (!bits) continue;
+                _mm256_store_ps(h0s, h0);
+                _mm256_store_ps(h1s, h1);
+                _mm256_store_ps(h2s, h2);
+                ShadeLanes<8>(x, y, bits, fullGroup, h0s, h1s, h2s, shader);
             }
         }
     }
+
+    // Тот же Blend8 в 16-битных дорожках: альфа каждого пикселя размножается на его каналы,
+    // (x * 257) >> 16 даёт _mm_mulhi_epu16. Непокрытые пиксели остаются прежними
+    __attribute__((target("sse2")))
+    static __m128i BlendHalfSSE(__m128i s, __m128i d) {
+        const __m128i c255 = _mm_set1_epi16(255), c128 = _mm_set1_epi16(128), c257 = _mm_set1_epi16(257);
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+        __m128i x = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(a, s), _mm_mullo_epi16(_mm_sub_epi16(c255, a), d)), c128);
+        return _mm_mulhi_epu16(x, c257);
+    }
+
+    __attribute__((target("sse2")))
+    static void BlendLanesSSE(COLOR* dst, const COLOR* src, int bits) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i lo = BlendHalfSSE(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = BlendHalfSSE(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        __m128i blended = _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32((int)0xFF000000));
+        __m128i mask = _mm_set_epi32(bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(mask, blended), _mm_andnot_si128(mask, d)));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i BlendHalfAVX2(__m256i s, __m256i d) {
+        const __m256i c255 = _mm256_set1_epi16(255), c128 = _mm256_set1_epi16(128), c257 = _mm256_set1_epi16(257);
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+        __m256i x = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, s), _mm256_mullo_epi16(_mm256_sub_epi16(c255, a), d)), c128);
+        return _mm256_mulhi_epu16(x, c257);
+    }
+
+    __attribute__((target("avx2")))
+    static void BlendLanesAVX2(COLOR* dst, const COLOR* src, int bits) {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        // unpack/pack работают внутри 128-битных половин, поэтому порядок пикселей сохраняется
+        __m256i lo = BlendHalfAVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = BlendHalfAVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        __m256i blended = _mm256_or_si256(_mm256_packus_epi16(lo, hi), _mm256_set1_epi32((int)0xFF000000));
+        __m256i mask = _mm256_set_epi32(bits & 128 ? -1 : 0, bits & 64 ? -1 : 0, bits & 32 ? -1 : 0, bits & 16 ? -1 : 0,
+                                        bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(d, blended, mask));
+    }
+#endif
+
+    int tilesX, tilesY;
+    WorkerPool* pool;
+    std::vector<std::vector<int>> bins;
+    std::vector<std::function<void(Frame&, int, int, int, int)>> triangles;
+    COLOR clearColor;
+    bool clearPending;
+    RasterBackend backend;
+    std::vector<Rect> clearRects;
+    std::vector<Rect> drawnRects;
+    Rect changed;
+    bool cleared;
 };
 
 class LetterR {
@@ -1444,12 +4567,15 @@ public:
     }
     void Draw(Frame& f, const Matrix& m, float tm, float a, COLOR c) {
         std::vector<Vector> tv; for(auto& p : v) tv.push_back(p * m);
+        const PulseShader pulse(c, tm, a);
+        const WaveShader wave(c, tm, a);
+        const HoleShader hole(COLOR(0,0,0,255));
         for(size_t i=0; i<t.size(); ++i) {
             auto [i0, i1, i2] = t[i];
             Vector p0=tv[i0], p1=tv[i1], p2=tv[i2];
-            if(i<2) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, PulseShader(c, tm, a));
-            else if(i<7) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, WaveShader(c, tm, a));
-            else f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, HoleShader(COLOR(0,0,0,255)));
+            if(i<2) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, pulse);
+            else if(i<7) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, wave);
+            else f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, hole);
         }
     }
 };
@@ -1464,14 +4590,128 @@ public:
     }
     void Draw(Frame& f, const Matrix& m, float tm, float a, COLOR c) {
         std::vector<Vector> tv; for(auto& p : v) tv.push_back(p * m);
+        const FloodShader flood(c, tm, a);
+        const GradientShader gradient(c, tm, a);
+        const FlickerShader flicker(c, tm, a);
         for(size_t i=0; i<t.size(); ++i) {
             auto [i0, i1, i2] = t[i];
             Vector p0=tv[i0], p1=tv[i1], p2=tv[i2];
-            if(i<2) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, FloodShader(c, tm, a));
-            else if(i<4) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, GradientShader(c, tm, a));
-            else f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, FlickerShader(c, tm, a));
+            if(i<2) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, flood);
+            else if(i<4) f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, gradient);
+            else f.DrawTriangle(p0.x,p0.y,p1.x,p1.y,p2.x,p2.y, flicker);
+        }
+    }
+};
+
+// Растеризация в собственном потоке: три кадра по очереди становятся рисуемым, готовым и
+// читаемым GL-потоком. Готовый кадр передаётся атомарным exchange индекса, без блокировок,
+// поэтому время кадра определяется большим из растеризации и рендеринга, а не их суммой
+class FrameProducer {
+public:
+    typedef std::function<void(Frame&, float)> RenderFn;
+    static const int SLOTS = 3;
+
+    FrameProducer(const Frame& prototype, RenderFn renderFn)
+        : frames(SLOTS, prototype), infos(SLOTS), render(renderFn), back(0), front(1), ready(2),
+          requested(false), requestTime(0.0f), requestPool(nullptr), running(true), uploadedValid(false) {
+        thread = std::thread(&FrameProducer::produceLoop, this);
+    }
+
+    ~FrameProducer() { stop(); }
+
+    FrameProducer(const FrameProducer&) = delete;
+    FrameProducer& operator=(const FrameProducer&) = delete;
+
+    // Заказывает кадр на момент time; незабранный заказ заменяется новым
+    void request(float time, WorkerPool* pool) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested = true;
+            requestTime = time;
+            requestPool = pool;
+        }
+        wake.notify_one();
+    }
+
+    // Забирает последний готовый кадр или nullptr, если нового нет. uploadRect — область,
+    // в которой он отличается от кадра, взятого в прошлый раз (при первом вызове — весь кадр)
+    Frame* acquire(Rect& uploadRect) {
+        if (!(ready.load(std::memory_order_acquire) & FRESH)) return nullptr;
+        front = ready.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+
+        const SlotInfo& info = infos[front];
+        const Frame& frame = frames[front];
+        bool sameBackground = uploadedValid && uploaded.cleared && info.cleared &&
+                              info.clearColor.r == uploaded.clearColor.r && info.clearColor.g == uploaded.clearColor.g &&
+                              info.clearColor.b == uploaded.clearColor.b && info.clearColor.a == uploaded.clearColor.a;
+        // Оба кадра — фон одного цвета плюс нарисованное, значит различаются только там, где рисовали
+        uploadRect = sameBackground ? uploaded.drawn.Union(info.drawn) : Rect(0, 0, frame.Width(), frame.Height());
+        uploaded = info;
+        uploadedValid = true;
+        return &frames[front];
+    }
+
+    void stop() {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+private:
+    struct SlotInfo {
+        Rect drawn;
+        COLOR clearColor;
+        bool cleared;
+        SlotInfo() : cleared(false) {}
+    };
+
+    static const int FRESH = 4;
+    static const int INDEX_MASK = 3;
+
+    void produceLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return requested || !running; });
+            if (!running) break;
+            float time = requestTime;
+            WorkerPool* pool = requestPool;
+            requested = false;
+            lock.unlock();
+
+            Frame& frame = frames[back];
+            if (frame.Tiled() != (pool != nullptr)) frame.SetTiled(pool);
+            render(frame, time);
+            frame.Flush();
+            frame.TakeChangedRect();
+            infos[back].drawn = frame.DrawnBounds();
+            infos[back].cleared = frame.Cleared();
+            infos[back].clearColor = frame.ClearColor();
+            back = ready.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+
+            lock.lock();
         }
     }
+
+    std::vector<Frame> frames;
+    std::vector<SlotInfo> infos;
+    RenderFn render;
+    int back, front;
+    std::atomic<int> ready;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool requested;
+    float requestTime;
+    WorkerPool* requestPool;
+    bool running;
+    std::thread thread;
+
+    SlotInfo uploaded;
+    bool uploadedValid;
 };
 
 } // namespace Software2D
@@ -1490,16 +4730,69 @@ void processInput(SDL_Window* window, float deltaTime, bool& running) {
                     break;
                 case SDLK_1:
                     directionalLightEnabled = !directionalLightEnabled;
+                    sceneUniformsDirty = true;
                     std::cout << "Directional Light: " << (directionalLightEnabled ? "ON" : "OFF") << std::endl;
                     break;
                 case SDLK_2:
                     pointLightEnabled = !pointLightEnabled;
+                    sceneUniformsDirty = true;
                     std::cout << "Point Light: " << (pointLightEnabled ? "ON" : "OFF") << std::endl;
                     break;
                 case SDLK_3:
                     spotLightEnabled = !spotLightEnabled;
+                    sceneUniformsDirty = true;
                     std::cout << "Spot Light: " << (spotLightEnabled ? "ON" : "OFF") << std::endl;
                     break;
+                case SDLK_i:
+                    instancedRendering = !instancedRendering;
+                    if (!instancedRendering) gpuAnimation = false;
+                    std::cout << "Instanced rendering: " << (instancedRendering ? "ON" : "OFF") << std::endl;
+                    break;
+                case SDLK_g:
+                    gpuAnimation = !gpuAnimation;
+                    if (gpuAnimation) instancedRendering = true;
+                    std::cout << "GPU animation: " << (gpuAnimation ? "ON" : "OFF") << std::endl;
+                    break;
+                case SDLK_c:
+                    frustumCulling = !frustumCulling;
+                    std::cout << "Frustum culling: " << (frustumCulling ? "ON" : "OFF") << " (last frame: drawn "
+                              << objectsDrawn << ", culled " << objectsCulled << ")" << std::endl;
+                    break;
+                case SDLK_l:
+                    levelOfDetail = !levelOfDetail;
+                    std::cout << "Level of detail: " << (levelOfDetail ? "ON" : "OFF") << " (last frame per level:";
+                    for (int level = 0; level < LOD_LEVELS; ++level) std::cout << " " << objectsPerLod[level];
+                    std::cout << ")" << std::endl;
+                    break;
+                case SDLK_p:
+                    shadowsEnabled = !shadowsEnabled;
+                    std::cout << "Shadows: " << (shadowsEnabled ? "ON" : "OFF") << std::endl;
+                    break;
+                case SDLK_k:
+                    clusteredLighting = !clusteredLighting;
+                    std::cout << "Clustered lights: " << (clusteredLighting ? "ON" : "OFF") << " (last frame per cluster: avg "
+                              << lightsPerClusterAverage << ", max " << lightsPerClusterMax << ")" << std::endl;
+                    break;
+                case SDLK_o:
+                    sortedDraws = !sortedDraws;
+                    std::cout << "Draw sorting: " << (sortedDraws ? "ON" : "OFF") << " (last frame: "
+                              << stateChangesAvoided << " state changes avoided)" << std::endl;
+                    break;
+                case SDLK_y:
+                    profiler.report(std::cout);
+                    break;
+                case SDLK_z:
+                    depthPrepass = !depthPrepass;
+                    std::cout << "Depth pre-pass: " << (depthPrepass ? "ON" : "OFF") << std::endl;
+                    break;
+                case SDLK_m:
+                    glassMonolith = !glassMonolith;
+                    std::cout << "Translucent monolith: " << (glassMonolith ? "ON" : "OFF") << std::endl;
+                    break;
+                case SDLK_t:
+                    tiledRaster = !tiledRaster;
+                    std::cout << "Tiled software raster: " << (tiledRaster ? "ON" : "OFF") << std::endl;
+                    break;
                 case SDLK_f:
                     static bool fullscreen = false;
                     fullscreen = !fullscreen;
@@ -1512,6 +4805,17 @@ void processInput(SDL_Window* window, float deltaTime, bool& running) {
                     std::cout << "Колесо мыши: Приближение/отдаление" << std::endl;
                     std::cout << "1, 2, 3: Включение/выключение источников света" << std::endl;
                     std::cout << "Стрелки + PageUp/Down: Движение точечного источника" << std::endl;
+                    std::cout << "I: Инстансинг вкл/выкл" << std::endl;
+                    std::cout << "G: Анимация орбит на GPU" << std::endl;
+                    std::cout << "T: Растеризация текстуры по тайлам" << std::endl;
+                    std::cout << "C: Отсечение по пирамиде видимости" << std::endl;
+                    std::cout << "L: Уровни детализации" << std::endl;
+                    std::cout << "O: Сортировка draw-вызовов по состоянию" << std::endl;
+                    std::cout << "P: Тени" << std::endl;
+                    std::cout << "K: Дополнительные источники (кластерное освещение)" << std::endl;
+                    std::cout << "Z: Предварительный проход глубины" << std::endl;
+                    std::cout << "M: Полупрозрачный монолит" << std::endl;
+                    std::cout << "Y: Профиль кадра (CPU/GPU по участкам)" << std::endl;
                     std::cout << "F: Полный экран" << std::endl;
                     std::cout << "H: Помощь" << std::endl;
                     std::cout << "ESC: Выход" << std::endl;
@@ -1537,10 +4841,12 @@ void processInput(SDL_Window* window, float deltaTime, bool& running) {
             lastY = event.motion.y;
             
             camera.ProcessMouseMovement(xoffset, yoffset);
+            sceneUniformsDirty = true;
         }
         
         if (event.type == SDL_MOUSEWHEEL) {
             camera.ProcessMouseScroll(event.wheel.y);
+            sceneUniformsDirty = true;
         }
     }
     
@@ -1560,9 +4866,79 @@ void processInput(SDL_Window* window, float deltaTime, bool& running) {
     if (keyState[SDL_SCANCODE_RIGHT]) pointLightPos.x += lightSpeed;
     if (keyState[SDL_SCANCODE_PAGEUP]) pointLightPos.y += lightSpeed;
     if (keyState[SDL_SCANCODE_PAGEDOWN]) pointLightPos.y -= lightSpeed;
+
+    const SDL_Scancode movementKeys[] = {
+        SDL_SCANCODE_W, SDL_SCANCODE_S, SDL_SCANCODE_A, SDL_SCANCODE_D, SDL_SCANCODE_SPACE, SDL_SCANCODE_LSHIFT,
+        SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT, SDL_SCANCODE_PAGEUP, SDL_SCANCODE_PAGEDOWN
+    };
+    for (SDL_Scancode key : movementKeys) {
+        if (keyState[key]) sceneUniformsDirty = true;
+    }
+}
+
+void parseArguments(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--instanced") {
+            instancedRendering = true;
+        } else if (arg == "--gpu-animation") {
+            instancedRendering = true;
+            gpuAnimation = true;
+        } else if (arg == "--packed-vertices") {
+            defaultVertexFormat = VertexFormat::Packed;
+        } else if (arg == "--sync-textures") {
+            asyncTextures = false;
+        } else if (arg == "--serial-raster") {
+            tiledRaster = false;
+        } else if (arg == "--raster-thread") {
+            rasterThread = true;
+        } else if (arg == "--soft-size" && i + 1 < argc) {
+            softwareTextureSize = std::max(64, std::atoi(argv[++i]));
+        } else if (arg == "--raster-backend" && i + 1 < argc) {
+            rasterBackendOverride = argv[++i];
+        } else if (arg == "--lights" && i + 1 < argc) {
+            extraLightCount = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--deferred") {
+            deferredShading = true;
+        } else if (arg == "--depth-prepass") {
+            depthPrepass = true;
+        } else if (arg == "--glass-monolith") {
+            glassMonolith = true;
+        } else if (arg == "--benchmark" && i + 1 < argc) {
+            benchmarkFrames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--checksum") {
+            benchmarkChecksum = true;
+        } else if (arg == "--profile-csv" && i + 1 < argc) {
+            profileCsvPath = argv[++i];
+        } else if (arg == "--profile-trace" && i + 1 < argc) {
+            profileTracePath = argv[++i];
+        } else if (arg == "--no-shadows") {
+            shadowsEnabled = false;
+        } else if (arg == "--shadow-size" && i + 1 < argc) {
+            shadowMapSize = std::max(128, std::atoi(argv[++i]));
+        } else if (arg == "--no-sort") {
+            sortedDraws = false;
+        } else if (arg == "--no-lod") {
+            levelOfDetail = false;
+        } else if (arg == "--no-culling") {
+            frustumCulling = false;
+        } else if (arg == "--no-indirect") {
+            multiDrawIndirect = false;
+        } else if (arg == "--asteroids" && i + 1 < argc) {
+            asteroidCount = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+        }
+    }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    parseArguments(argc, argv);
+    if (benchmarkFrames > 0) {
+        // Кадр бенчмарка не должен зависеть от того, когда догрузилась текстура или дорисовал поток растеризации
+        asyncTextures = false;
+        rasterThread = false;
+    }
     std::cout << "Starting program..." << std::endl;
     
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
@@ -1582,7 +4958,7 @@ int main() {
                                          SDL_WINDOWPOS_CENTERED,
                                          SDL_WINDOWPOS_CENTERED,
                                          SCR_WIDTH, SCR_HEIGHT,
-                                         SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+                                         SDL_WINDOW_OPENGL | (benchmarkFrames > 0 ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN));
     if (!window) {
         std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
         SDL_Quit();
@@ -1598,7 +4974,7 @@ int main() {
         return -1;
     }
     
-    SDL_GL_SetSwapInterval(1);
+    SDL_GL_SetSwapInterval(benchmarkFrames > 0 ? 0 : 1);
     
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
@@ -1626,7 +5002,7 @@ int main() {
     }
     
     glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
+    // Смешивание включается только на время полупрозрачных объектов
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
     
@@ -1636,10 +5012,14 @@ int main() {
     }
     
     std::cout << "Compiling shaders..." << std::endl;
-    Shader lightingShader(vertexShaderSource, fragmentShaderSource, false);
+    std::string sceneVertexSource = std::string("#version 330 core\n") + objectTransformSource + vertexShaderSource;
+    std::string forwardShaderSource = std::string("#version 330 core\n") + lightingCommonSource + fragmentShaderSource;
+    Shader lightingShader(sceneVertexSource.c_str(), forwardShaderSource.c_str(), false);
     Shader lightCubeShader(lightCubeShaderVS, lightCubeShaderFS, false);
+    // Вершинный шейдер сцены с пустым фрагментным, как у карт теней
+    Shader depthPrepassShader(sceneVertexSource.c_str(), shadowDepthFS, false);
 
-    if (lightingShader.ID == 0 || lightCubeShader.ID == 0) {
+    if (lightingShader.ID == 0 || lightCubeShader.ID == 0 || depthPrepassShader.ID == 0) {
         std::cerr << "Failed to compile shaders!" << std::endl;
         SDL_GL_DeleteContext(context);
         SDL_DestroyWindow(window);
@@ -1647,18 +5027,40 @@ int main() {
         return -1;
     }
     std::cout << "Shaders compiled successfully" << std::endl;
+
+    SceneUniforms sceneUniforms;
+    sceneUniforms.init();
+    lightingShader.bindUniformBlock("Matrices", SceneUniforms::MATRICES_BINDING);
+    lightingShader.bindUniformBlock("Lights", SceneUniforms::LIGHTS_BINDING);
+    lightCubeShader.bindUniformBlock("Matrices", SceneUniforms::MATRICES_BINDING);
+    depthPrepassShader.bindUniformBlock("Matrices", SceneUniforms::MATRICES_BINDING);
+
+    lightingShader.use();
+    lightingShader.setFloat("material.shininess", 64.0f);
+    lightingShader.setFloat("opacity", 1.0f);
+
+    ShadowMaps shadowMaps;
+    shadowMaps.init(shadowMapSize);
+
+    GBuffer gBuffer;
+    if (deferredShading && !gBuffer.init()) {
+        std::cerr << "Failed to compile deferred shading shaders, using forward rendering" << std::endl;
+        deferredShading = false;
+    }
     
     std::cout << "Creating scene objects..." << std::endl;
 
    std::vector<SceneObject> objects;
+   objects.reserve(11 + asteroidCount);
 
-   unsigned int marbleTexture = loadTexture("marble.jpg");
+   TextureLoader textureLoader;
+   GLTexture marbleTexture(asyncTextures ? textureLoader.request("marble.jpg") : loadTexture("marble.jpg"));
 
     std::cout << "Creating textured plane..." << std::endl;
-    Mesh planeMesh = createPlane(100.0f, glm::vec3(1.0f), marbleTexture);
+    Mesh planeMesh = createPlane(100.0f, glm::vec3(1.0f), marbleTexture.get());
 
     objects.push_back(SceneObject(
-        planeMesh,
+        std::move(planeMesh),
         glm::vec3(0.0f, -5.0f, 0.0f),
         glm::vec3(1.0f),
         0.0f,
@@ -1670,24 +5072,73 @@ int main() {
         0.0f, 0.0f
     ));
 
-    const int TEX_WIDTH = 512;
-    const int TEX_HEIGHT = 512;
+    const int TEX_WIDTH = softwareTextureSize;
+    const int TEX_HEIGHT = softwareTextureSize;
 
     Software2D::Frame dynamicFrame(TEX_WIDTH, TEX_HEIGHT);
+    Software2D::WorkerPool rasterPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    dynamicFrame.SetTiled(tiledRaster ? &rasterPool : nullptr);
+    if (!rasterBackendOverride.empty()) {
+        Software2D::RasterBackend requested = dynamicFrame.Backend();
+        if (rasterBackendOverride == "scalar") requested = Software2D::RasterBackend::Scalar;
+        else if (rasterBackendOverride == "sse") requested = Software2D::RasterBackend::SSE;
+        else if (rasterBackendOverride == "avx2") requested = Software2D::RasterBackend::AVX2;
+        else std::cerr << "Unknown raster backend: " << rasterBackendOverride << std::endl;
+
+        // Бэкенды упорядочены по набору инструкций: всё не выше найденного процессором поддерживается
+        Software2D::RasterBackend detected = Software2D::DetectRasterBackend();
+        if ((int)requested > (int)detected) {
+            std::cerr << "Raster backend " << Software2D::RasterBackendName(requested) << " is not supported by this CPU, using "
+                      << Software2D::RasterBackendName(detected) << std::endl;
+            requested = detected;
+        }
+        dynamicFrame.SetBackend(requested);
+    }
+    std::cout << "Software raster: " << Software2D::RasterBackendName(dynamicFrame.Backend()) << ", "
+              << (dynamicFrame.Tiled() ? rasterPool.threads() : 1) << " thread(s)"
+              << (rasterThread ? ", producer thread" : "") << std::endl;
     Software2D::LetterR letterR;
     Software2D::LetterA letterA;
 
-    unsigned int dynamicTexID = createDynamicTexture(TEX_WIDTH, TEX_HEIGHT);
+    auto renderLetters = [&](Software2D::Frame& frame, float time) {
+        frame.Clear(Software2D::COLOR(40, 0, 60, 255));
+        
+        auto WS = Software2D::Matrix::WorldToScreen(
+            50, 50, TEX_WIDTH - 50, TEX_HEIGHT - 50, 
+            -3.0f, -3.0f, 3.0f, 3.0f 
+        );
+
+        float angle2D = time * 90.0f;
+        auto transR = Software2D::Matrix::Translation(-1.2f, 0.0f) * 
+                      Software2D::Matrix::Rotation(angle2D) * 
+                      Software2D::Matrix::Scaling(1.5f, 1.5f) * 
+                      WS;
+        letterR.Draw(frame, transR, time, 1.0f, Software2D::COLOR(100, 200, 255, 255));
+
+        auto transA = Software2D::Matrix::Translation(1.5f * cos(time * 2.0f), 1.5f * sin(time * 2.0f)) * 
+                      Software2D::Matrix::Rotation(-angle2D) * 
+                      Software2D::Matrix::Scaling(1.5f, 1.5f) * 
+                      WS;
+        letterA.Draw(frame, transA, time, 1.0f, Software2D::COLOR(255, 100, 100, 255));
+    };
+    std::unique_ptr<Software2D::FrameProducer> rasterProducer;
+    if (rasterThread) rasterProducer.reset(new Software2D::FrameProducer(dynamicFrame, renderLetters));
+
+    GLTexture dynamicTexture(createDynamicTexture(TEX_WIDTH, TEX_HEIGHT));
+    unsigned int dynamicTexID = dynamicTexture.get();
+    PixelUploadRing dynamicUploads;
+    dynamicUploads.init((size_t)TEX_WIDTH * TEX_HEIGHT * 4);
     
     Mesh bigCubeMesh;
     {
         bigCubeMesh = createCube(glm::vec3(1.0f), 1.0f); 
         bigCubeMesh.textures[0].id = dynamicTexID; 
-        bigCubeMesh.textures[1].id = createSolidColorTexture(glm::vec3(0.0f)); 
+        bigCubeMesh.textures[1].id = ResourceCache::instance().solidColorTexture(glm::vec3(0.0f)); 
     }
 
+    size_t monolithIndex = objects.size();
     objects.push_back(SceneObject(
-        bigCubeMesh,
+        std::move(bigCubeMesh),
         glm::vec3(0.0f, 15.0f, 0.0f), 
         glm::vec3(8.0f),              
         0.5f,                         
@@ -1699,9 +5150,12 @@ int main() {
         0.0f, 0.0f
     ));
     
-    Mesh sunMesh = createSphere(1.0f, 32, 16, glm::vec3(1.0f, 0.9f, 0.0f)); 
+    auto sunLOD = [](int level) {
+        return createSphere(1.0f, lodSegments(32, level, 6), lodSegments(16, level, 4), glm::vec3(1.0f, 0.9f, 0.0f));
+    };
+    Mesh sunMesh = sunLOD(0);
     objects.push_back(SceneObject(
-        sunMesh,
+        std::move(sunMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(3.0f),       
         0.5f,                  
@@ -1710,10 +5164,11 @@ int main() {
         "Солнце",
         0.0f, 0.0f            
     ));
+    objects.back().lods = createLODs(sunLOD);
     
     Mesh mercuryMesh = createCube(glm::vec3(0.6f, 0.6f, 0.6f), 1.0f);
     objects.push_back(SceneObject(
-        mercuryMesh,
+        std::move(mercuryMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(0.5f),
         1.0f,
@@ -1725,7 +5180,7 @@ int main() {
 
     Mesh venusMesh = createIcosahedron(1.0f, glm::vec3(0.9f, 0.6f, 0.2f));
     objects.push_back(SceneObject(
-        venusMesh,
+        std::move(venusMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(0.7f),
         -0.8f,               
@@ -1735,9 +5190,12 @@ int main() {
         8.0f, 1.2f
     ));
 
-    Mesh earthMesh = createSphere(1.0f, 32, 16, glm::vec3(0.2f, 0.4f, 1.0f));
+    auto earthLOD = [](int level) {
+        return createSphere(1.0f, lodSegments(32, level, 6), lodSegments(16, level, 4), glm::vec3(0.2f, 0.4f, 1.0f));
+    };
+    Mesh earthMesh = earthLOD(0);
     objects.push_back(SceneObject(
-        earthMesh,
+        std::move(earthMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(0.8f),
         2.0f,
@@ -1746,10 +5204,11 @@ int main() {
         "Земля",
         11.0f, 1.0f            
     ));
+    objects.back().lods = createLODs(earthLOD);
 
     Mesh marsMesh = createOctahedron(1.0f, glm::vec3(1.0f, 0.2f, 0.1f));
     objects.push_back(SceneObject(
-        marsMesh,
+        std::move(marsMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(0.6f),
         1.8f,
@@ -1759,9 +5218,12 @@ int main() {
         15.0f, 0.8f
     ));
 
-    Mesh jupiterMesh = createTorus(1.0f, 0.3f, 32, 16, glm::vec3(0.8f, 0.5f, 0.3f));
+    auto jupiterLOD = [](int level) {
+        return createTorus(1.0f, 0.3f, lodSegments(32, level, 8), lodSegments(16, level, 4), glm::vec3(0.8f, 0.5f, 0.3f));
+    };
+    Mesh jupiterMesh = jupiterLOD(0);
     objects.push_back(SceneObject(
-        jupiterMesh,
+        std::move(jupiterMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(1.8f),
         4.0f,                  
@@ -1770,10 +5232,14 @@ int main() {
         "Юпитер",
         22.0f, 0.5f            
     ));
+    objects.back().lods = createLODs(jupiterLOD);
 
-    Mesh saturnMesh = createHelix(1.0f, 0.5f, 3.0f, 60, glm::vec3(0.9f, 0.8f, 0.6f));
+    auto saturnLOD = [](int level) {
+        return createHelix(1.0f, 0.5f, 3.0f, lodSegments(60, level, 12), glm::vec3(0.9f, 0.8f, 0.6f));
+    };
+    Mesh saturnMesh = saturnLOD(0);
     objects.push_back(SceneObject(
-        saturnMesh,
+        std::move(saturnMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(1.5f),
         1.0f,
@@ -1782,10 +5248,14 @@ int main() {
         "Сатурн",
         28.0f, 0.4f
     ));
+    objects.back().lods = createLODs(saturnLOD);
 
-    Mesh uranusMesh = createCylinder(0.5f, 2.0f, 24, glm::vec3(0.4f, 0.9f, 0.9f));
+    auto uranusLOD = [](int level) {
+        return createCylinder(0.5f, 2.0f, lodSegments(24, level, 6), glm::vec3(0.4f, 0.9f, 0.9f));
+    };
+    Mesh uranusMesh = uranusLOD(0);
     objects.push_back(SceneObject(
-        uranusMesh,
+        std::move(uranusMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(1.0f),
         1.0f,
@@ -1794,10 +5264,14 @@ int main() {
         "Уран",
         34.0f, 0.3f
     ));
+    objects.back().lods = createLODs(uranusLOD);
 
-    Mesh neptuneMesh = createCone(0.6f, 1.8f, 24, glm::vec3(0.1f, 0.1f, 0.8f));
+    auto neptuneLOD = [](int level) {
+        return createCone(0.6f, 1.8f, lodSegments(24, level, 6), glm::vec3(0.1f, 0.1f, 0.8f));
+    };
+    Mesh neptuneMesh = neptuneLOD(0);
     objects.push_back(SceneObject(
-        neptuneMesh,
+        std::move(neptuneMesh),
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(1.0f),
         1.5f,
@@ -1806,7 +5280,66 @@ int main() {
         "Нептун",
         39.0f, 0.2f
     ));
+    objects.back().lods = createLODs(neptuneLOD);
     
+    if (asteroidCount > 0) {
+        std::cout << "Creating asteroid belt: " << asteroidCount << " objects..." << std::endl;
+        const glm::vec3 asteroidColors[] = {
+            glm::vec3(0.55f, 0.5f, 0.45f), glm::vec3(0.45f, 0.42f, 0.4f), glm::vec3(0.6f, 0.45f, 0.35f)
+        };
+        std::mt19937 rng(2024);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < asteroidCount; ++i) {
+            const glm::vec3& asteroidColor = asteroidColors[i % 3];
+            objects.push_back(SceneObject(
+                createIcosahedron(1.0f, asteroidColor),
+                glm::vec3(0.0f, (unit(rng) - 0.5f) * 2.0f, 0.0f),
+                glm::vec3(0.1f + 0.2f * unit(rng)),
+                0.5f + 2.0f * unit(rng),
+                glm::vec3(unit(rng), 1.0f, unit(rng)),
+                true, false, asteroidColor,
+                "Астероид",
+                44.0f + 12.0f * unit(rng), 0.05f + 0.15f * unit(rng), 2.0f * M_PI * unit(rng)
+            ));
+        }
+    }
+
+    // Дополнительные источники над полом: четверть из них - прожекторы, светящие вниз.
+    // Исходные позиции хранятся отдельно, в кадре источники поворачиваются вокруг оси Y
+    ClusteredLights clusteredLights;
+    std::vector<glm::vec3> lightAnchors;
+    if (extraLightCount > 0) {
+        std::cout << "Creating clustered lights: " << extraLightCount << "..." << std::endl;
+        clusteredLights.init();
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < extraLightCount; ++i) {
+            ClusteredLights::Light light;
+            light.position = glm::vec3((unit(rng) - 0.5f) * 90.0f, -4.0f + 6.0f * unit(rng), (unit(rng) - 0.5f) * 90.0f);
+            light.radius = 4.0f + 6.0f * unit(rng);
+            float hue = unit(rng) * 6.0f;
+            light.color = glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f) * 1.5f;
+            light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            light.spot = i % 4 == 0;
+            light.cosInner = glm::cos(glm::radians(20.0f));
+            light.cosOuter = glm::cos(glm::radians(35.0f));
+            clusteredLights.lights.push_back(light);
+            lightAnchors.push_back(light.position);
+        }
+    }
+
+    ResourceCache::instance().printStats();
+
+    InstancedRenderer instancedRenderer;
+    instancedRenderer.setMultiDrawIndirect(multiDrawIndirect);
+    instancedRenderer.build(objects);
+    std::cout << "Instanced batches: " << instancedRenderer.batchCount() << " for " << objects.size() << " objects"
+              << (instancedRenderer.multiDrawIndirectActive() ? " (multi-draw indirect)" : "") << std::endl;
+    const GeometryArena& arena = GeometryArena::instance(defaultVertexFormat);
+    std::cout << "Geometry arena (" << (defaultVertexFormat == VertexFormat::Packed ? "packed" : "float") << "): "
+              << arena.vertices() << " vertices, " << arena.indices() << " indices, "
+              << arena.vertexBytes() / 1024 << " KB vertex data" << std::endl;
+
     std::cout << "Creating light sphere..." << std::endl;
     Mesh pointLightSphere = createSphere(0.3f, 16, 8, glm::vec3(1.0f, 1.0f, 0.8f));
     glError = glGetError();
@@ -1821,28 +5354,105 @@ int main() {
     std::cout << "Колесо мыши: Приближение/отдаление" << std::endl;
     std::cout << "1, 2, 3: Включение/выключение источников света" << std::endl;
     std::cout << "Стрелки + PageUp/Down: Движение точечного источника" << std::endl;
+    std::cout << "I: Инстансинг вкл/выкл" << std::endl;
+    std::cout << "G: Анимация орбит на GPU" << std::endl;
+    std::cout << "T: Растеризация текстуры по тайлам" << std::endl;
+    std::cout << "C: Отсечение по пирамиде видимости" << std::endl;
+    std::cout << "L: Уровни детализации" << std::endl;
+    std::cout << "O: Сортировка draw-вызовов по состоянию" << std::endl;
+    std::cout << "P: Тени" << std::endl;
+    std::cout << "K: Дополнительные источники (кластерное освещение)" << std::endl;
+    std::cout << "Z: Предварительный проход глубины" << std::endl;
+    std::cout << "M: Полупрозрачный монолит" << std::endl;
+    std::cout << "Y: Профиль кадра (CPU/GPU по участкам)" << std::endl;
     std::cout << "F: Полный экран" << std::endl;
     std::cout << "H: Помощь" << std::endl;
     std::cout << "ESC: Выход" << std::endl;
     std::cout << "==============================" << std::endl;
     std::cout << "All objects created successfully!" << std::endl;
     std::cout << "Entering main loop..." << std::endl;
+
+    const Shader::Handle modelHandle = Shader::handle("model");
+    const Shader::Handle useVertexColorHandle = Shader::handle("useVertexColor");
+    const Shader::Handle useGradientHandle = Shader::handle("useGradient");
+    const Shader::Handle instancedHandle = Shader::handle("instanced");
+    const Shader::Handle gpuAnimationHandle = Shader::handle("gpuAnimation");
+    const Shader::Handle timeHandle = Shader::handle("time");
+    const Shader::Handle opacityHandle = Shader::handle("opacity");
     
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
     float totalTime = 0.0f;
     bool running = true;
+    int lastWidth = 0, lastHeight = 0;
+    std::vector<unsigned char> objectSelection;
+    InstancedRenderer::DrawList sceneDraws;
+    RenderQueue renderQueue;
+    // В отложенном режиме объекты рисуются в G-буфер, освещение считается отдельным проходом
+    Shader& sceneShader = deferredShading ? gBuffer.geometry() : lightingShader;
+    std::vector<std::pair<float, size_t>> translucentDraws;
+
+    // Участки кадра для профилировщика; в отложенном режиме scene - геометрический проход
+    const int inputScope = profiler.scope("input", false);
+    const int shadowScope = profiler.scope("shadows", true);
+    const int clusterScope = profiler.scope("clusters", false);
+    const int rasterScope = profiler.scope("raster", false);
+    const int uploadScope = profiler.scope("upload", true);
+    const int cullingScope = profiler.scope("culling", false);
+    const int prepassScope = profiler.scope("prepass", true);
+    const int sceneScope = profiler.scope("scene", true);
+    const int lightingScope = profiler.scope("lighting", true);
+    const int swapScope = profiler.scope("swap", false);
+    if (!profileCsvPath.empty()) profiler.openCsv(profileCsvPath);
+    if (!profileTracePath.empty()) profiler.openTrace(profileTracePath);
+    size_t frameCount = 0;
+
+    // Скрытое окно бенчмарка не обязано иметь пригодный кадровый буфер, поэтому сцена идёт в свой FBO
+    GLuint benchmarkFBO = 0;
+    GLuint benchmarkRenderbuffers[2] = { 0, 0 };
+    if (benchmarkFrames > 0) {
+        glGenRenderbuffers(2, benchmarkRenderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, benchmarkRenderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, benchmarkRenderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &benchmarkFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, benchmarkFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchmarkRenderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, benchmarkRenderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Benchmark framebuffer is incomplete" << std::endl;
+        }
+        outputFramebuffer = benchmarkFBO;
+        std::cout << "Benchmark: " << benchmarkFrames << " frames at " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+    }
+    auto benchmarkStart = std::chrono::steady_clock::now();
     
     while (running) {
+        profiler.beginFrame();
         float currentFrame = SDL_GetTicks() / 1000.0f;
-        deltaTime = currentFrame - lastFrame;
+        deltaTime = benchmarkFrames > 0 ? BENCHMARK_STEP : currentFrame - lastFrame;
         lastFrame = currentFrame;
         totalTime += deltaTime;
+
+        if (benchmarkFrames > 0) {
+            // Облёт сцены по кругу за 20 секунд времени сцены, с покачиванием по высоте
+            float angle = totalTime * 2.0f * (float)M_PI / 20.0f;
+            camera.LookAt(glm::vec3(50.0f * sinf(angle), 30.0f + 8.0f * sinf(angle * 2.0f), 50.0f * cosf(angle)),
+                          glm::vec3(0.0f, 5.0f, 0.0f));
+            sceneUniformsDirty = true;
+        }
         
+        profiler.begin(inputScope);
         processInput(window, deltaTime, running);
+        textureLoader.update();
+        profiler.end(inputScope);
         
-        int width, height;
-        SDL_GetWindowSize(window, &width, &height);
+        int width = SCR_WIDTH, height = SCR_HEIGHT;
+        if (benchmarkFrames == 0) SDL_GetWindowSize(window, &width, &height);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
         glViewport(0, 0, width, height);
         
         glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
@@ -1851,113 +5461,292 @@ int main() {
         glm::mat4 projection = glm::perspective(
             glm::radians(camera.Zoom),
             (float)width / (float)height,
-            0.1f, 200.0f
+            CAMERA_NEAR, CAMERA_FAR
         );
         glm::mat4 view = camera.GetViewMatrix();
         
-        lightingShader.use();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-        lightingShader.setVec3("viewPos", camera.Position);
-        
-        lightingShader.setFloat("material.shininess", 64.0f);
-        
-        lightingShader.setVec3("dirLight.direction", glm::vec3(-0.5f, -1.0f, -0.3f));
-        lightingShader.setVec3("dirLight.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setVec3("dirLight.diffuse", glm::vec3(0.8f, 0.8f, 0.6f));
-        lightingShader.setVec3("dirLight.specular", glm::vec3(1.0f, 1.0f, 0.9f));
-        lightingShader.setBool("dirLight.enabled", directionalLightEnabled);
-        
-        lightingShader.setVec3("pointLight.position", pointLightPos);
-        lightingShader.setFloat("pointLight.constant", 1.0f);
-        lightingShader.setFloat("pointLight.linear", 0.09f);
-        lightingShader.setFloat("pointLight.quadratic", 0.032f);
-        lightingShader.setVec3("pointLight.ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        lightingShader.setVec3("pointLight.diffuse", glm::vec3(0.8f, 0.8f, 0.7f));
-        lightingShader.setVec3("pointLight.specular", glm::vec3(1.0f, 1.0f, 0.9f));
-        lightingShader.setBool("pointLight.enabled", pointLightEnabled);
-        
-        lightingShader.setVec3("spotLight.position", camera.Position);
-        lightingShader.setVec3("spotLight.direction", camera.Front);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(20.0f))); 
-        
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.02f);   
-        lightingShader.setFloat("spotLight.quadratic", 0.005f); 
-        
-        lightingShader.setVec3("spotLight.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setVec3("spotLight.diffuse", glm::vec3(3.0f, 3.0f, 3.0f)); 
-        lightingShader.setVec3("spotLight.specular", glm::vec3(3.0f, 3.0f, 3.0f)); 
-        lightingShader.setBool("spotLight.enabled", spotLightEnabled);
+        if (width != lastWidth || height != lastHeight) {
+            lastWidth = width;
+            lastHeight = height;
+            sceneUniformsDirty = true;
+        }
 
-        dynamicFrame.Clear(Software2D::COLOR(40, 0, 60, 255));
-        
-        auto WS = Software2D::Matrix::WorldToScreen(
-            50, 50, TEX_WIDTH - 50, TEX_HEIGHT - 50, 
-            -3.0f, -3.0f, 3.0f, 3.0f 
-        );
+        if (sceneUniformsDirty) {
+            MatricesBlock matrices = {};
+            matrices.projection = projection;
+            matrices.view = view;
+            matrices.viewPos = camera.Position;
+            sceneUniforms.upload(matrices, buildLightsBlock());
+            sceneUniformsDirty = false;
+        }
 
-        float angle2D = totalTime * 90.0f;
-        auto transR = Software2D::Matrix::Translation(-1.2f, 0.0f) * 
-                      Software2D::Matrix::Rotation(angle2D) * 
-                      Software2D::Matrix::Scaling(1.5f, 1.5f) * 
-                      WS;
-        letterR.Draw(dynamicFrame, transR, totalTime, 1.0f, Software2D::COLOR(100, 200, 255, 255));
+        // Экземпляры обновляются раз в кадр: их читают и карты теней, и instanced-проходы сцены
+        bool animatedOnGpu = instancedRendering && gpuAnimation;
+        if (instancedRendering || shadowsEnabled) instancedRenderer.update(objects, totalTime, animatedOnGpu);
 
-        auto transA = Software2D::Matrix::Translation(1.5f * cos(totalTime * 2.0f), 1.5f * sin(totalTime * 2.0f)) * 
-                      Software2D::Matrix::Rotation(-angle2D) * 
-                      Software2D::Matrix::Scaling(1.5f, 1.5f) * 
-                      WS;
-        letterA.Draw(dynamicFrame, transA, totalTime, 1.0f, Software2D::COLOR(255, 100, 100, 255));
+        if (shadowsEnabled) {
+            profiler.begin(shadowScope);
+            shadowMaps.render(objects, totalTime, camera, (float)width / (float)height, buildLightsBlock(),
+                              instancedRenderer, animatedOnGpu, levelOfDetail);
+            profiler.end(shadowScope);
+        }
 
-        glBindTexture(GL_TEXTURE_2D, dynamicTexID);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEX_WIDTH, TEX_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, dynamicFrame.getData());
+        bool clusteredActive = clusteredLighting && !clusteredLights.lights.empty();
+        if (clusteredActive) {
+            profiler.begin(clusterScope);
+            for (size_t i = 0; i < lightAnchors.size(); ++i) {
+                float angle = totalTime * 0.1f;
+                const glm::vec3& anchor = lightAnchors[i];
+                clusteredLights.lights[i].position = glm::vec3(anchor.x * cosf(angle) - anchor.z * sinf(angle), anchor.y,
+                                                               anchor.x * sinf(angle) + anchor.z * cosf(angle));
+            }
+            clusteredLights.update(view, projection, width, height, CAMERA_NEAR, CAMERA_FAR);
+            lightsPerClusterAverage = clusteredLights.averagePerCluster();
+            lightsPerClusterMax = clusteredLights.maxLightsPerCluster();
+            profiler.end(clusterScope);
+        }
+
+        if (deferredShading) {
+            gBuffer.resize(width, height);
+        } else {
+            lightingShader.use();
+            shadowMaps.bind(lightingShader, shadowsEnabled);
+            clusteredLights.bind(lightingShader, clusteredActive);
+        }
+
+        Software2D::Frame* uploadFrame = &dynamicFrame;
+        Software2D::Rect changedRect;
+        profiler.begin(rasterScope);
+        if (rasterProducer) {
+            // Заказ на этот кадр, а в текстуру идёт последний уже готовый
+            rasterProducer->request(totalTime, tiledRaster ? &rasterPool : nullptr);
+            uploadFrame = rasterProducer->acquire(changedRect);
+        } else {
+            if (dynamicFrame.Tiled() != tiledRaster) dynamicFrame.SetTiled(tiledRaster ? &rasterPool : nullptr);
+            renderLetters(dynamicFrame, totalTime);
+            dynamicFrame.Flush();
+            changedRect = dynamicFrame.TakeChangedRect();
+        }
+        profiler.end(rasterScope);
+
+        // В текстуру уходит только объемлющий прямоугольник изменённых областей
+        if (uploadFrame && !changedRect.Empty()) {
+            profiler.begin(uploadScope);
+            dynamicUploads.upload(dynamicTexID, changedRect.x0, changedRect.y0, changedRect.Width(), changedRect.Height(),
+                                  uploadFrame->Row(changedRect.y0) + changedRect.x0, TEX_WIDTH);
+            profiler.end(uploadScope);
+        }
         
-        for (size_t i = 0; i < objects.size(); ++i) {
-            glm::mat4 model = glm::mat4(1.0f);
-            
-            float orbitX = cos(totalTime * objects[i].orbitSpeed) * objects[i].orbitRadius;
-            float orbitZ = sin(totalTime * objects[i].orbitSpeed) * objects[i].orbitRadius;
-            
-            glm::vec3 currentPos = objects[i].position + glm::vec3(orbitX, 0.0f, orbitZ);
-            
-            model = glm::translate(model, currentPos);
- 
-            if (objects[i].rotationSpeed != 0.0f) {
-                model = glm::rotate(model, totalTime * objects[i].rotationSpeed, objects[i].rotationAxis);
+        // С GPU-анимацией матрицы объектов на CPU не строятся: видимость и уровень детализации
+        // считаются по ограничивающей сфере, а сами экземпляры лежат в буфере неизменными
+        profiler.begin(cullingScope);
+        objectsDrawn = objects.size();
+        objectsCulled = 0;
+        std::fill(objectsPerLod, objectsPerLod + LOD_LEVELS, 0);
+        translucentDraws.clear();
+        objects[monolithIndex].opacity = glassMonolith ? 0.5f : 1.0f;
+        bool hasTranslucent = std::any_of(objects.begin(), objects.end(), [](const SceneObject& o) { return o.isTranslucent(); });
+        bool selectObjects = frustumCulling || levelOfDetail || hasTranslucent;
+        if (selectObjects) {
+            Frustum frustum(projection * view);
+            float pixelsPerUnit = height / (2.0f * tanf(glm::radians(camera.Zoom) * 0.5f));
+            objectSelection.resize(objects.size());
+            for (size_t i = 0; i < objects.size(); ++i) {
+                SceneObject& object = objects[i];
+                glm::vec3 origin;
+                bool visible;
+                if (animatedOnGpu) {
+                    glm::vec4 sphere = object.boundingSphere(totalTime);
+                    origin = object.position + object.orbitOffset(totalTime);
+                    visible = !frustumCulling || !object.mesh.bounds.valid || frustum.visible(sphere);
+                    if (visible && levelOfDetail) object.selectLod(glm::vec3(sphere), sphere.w, camera.Position, pixelsPerUnit);
+                } else {
+                    glm::mat4 model = object.modelMatrix(totalTime);
+                    origin = glm::vec3(model[3]);
+                    visible = !frustumCulling || frustum.visible(object.mesh.bounds, model);
+                    if (visible && levelOfDetail) object.selectLod(model, camera.Position, pixelsPerUnit);
+                }
+                if (!visible) {
+                    objectSelection[i] = 0;
+                    ++objectsCulled;
+                    continue;
+                }
+                if (!levelOfDetail) object.lod = 0;
+                objectSelection[i] = (unsigned char)(object.lod + 1);
+                ++objectsPerLod[object.lod];
+                if (object.isTranslucent()) {
+                    // Непрозрачные проходы его пропускают
+                    translucentDraws.emplace_back(glm::length(origin - camera.Position), i);
+                    objectSelection[i] = 0;
+                }
             }
-            
-            model = glm::scale(model, objects[i].scale);
-            
-            lightingShader.setMat4("model", model);
-            lightingShader.setBool("useVertexColor", objects[i].useVertexColor);
-            lightingShader.setBool("useGradient", objects[i].useGradient);
-            
-            objects[i].mesh.Draw(lightingShader);
+            objectsDrawn -= objectsCulled;
+        }
+        profiler.end(cullingScope);
+
+        if (!instancedRendering && (sortedDraws || depthPrepass)) {
+            renderQueue.clear();
+            for (size_t i = 0; i < objects.size(); ++i) {
+                if (selectObjects && !objectSelection[i]) continue;
+                glm::mat4 model = objects[i].modelMatrix(totalTime);
+                float depth = glm::length(glm::vec3(model[3]) - camera.Position) / CAMERA_FAR;
+                renderQueue.add(0, objects[i], objects[i].lodMesh(selectObjects ? objectSelection[i] - 1 : 0), model, depth);
+            }
+            renderQueue.sort();
+        }
+
+        // Команды собираются один раз, даже если непрозрачное рисуется двумя проходами
+        if (instancedRendering) instancedRenderer.select(sceneDraws, selectObjects ? &objectSelection : nullptr);
+
+        auto drawOpaque = [&](Shader& shader, bool depthOnly) {
+            if (instancedRendering) {
+                shader.setBool(instancedHandle, true);
+                shader.setBool(gpuAnimationHandle, animatedOnGpu);
+                shader.setFloat(timeHandle, totalTime);
+                instancedRenderer.draw(shader, sceneDraws);
+                shader.setBool(instancedHandle, false);
+            } else if (depthOnly) {
+                renderQueue.drawDepth(shader);
+            } else if (sortedDraws) {
+                renderQueue.draw(shader);
+                stateChangesAvoided = renderQueue.stateChangesSkipped();
+            } else {
+                for (size_t i = 0; i < objects.size(); ++i) {
+                    if (selectObjects && !objectSelection[i]) continue;
+                    shader.setMat4(modelHandle, objects[i].modelMatrix(totalTime));
+                    shader.setBool(useVertexColorHandle, objects[i].useVertexColor);
+                    shader.setBool(useGradientHandle, objects[i].useGradient);
+                    
+                    objects[i].lodMesh(selectObjects ? objectSelection[i] - 1 : 0).Draw(shader);
+                }
+            }
+        };
+
+        if (deferredShading) gBuffer.beginGeometry();
+        if (depthPrepass) {
+            // Сначала только глубина, затем полное затенение лишь ближайшей поверхности каждого пикселя
+            profiler.begin(prepassScope);
+            depthPrepassShader.use();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawOpaque(depthPrepassShader, true);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            profiler.end(prepassScope);
+        }
+
+        profiler.begin(sceneScope);
+        sceneShader.use();
+        drawOpaque(sceneShader, false);
+        profiler.end(sceneScope);
+        if (depthPrepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+
+        if (deferredShading) {
+            profiler.begin(lightingScope);
+            gBuffer.light(shadowMaps, shadowsEnabled, clusteredLights, clusteredActive);
+            profiler.end(lightingScope);
         }
         
         if (pointLightEnabled) {
             lightCubeShader.use();
-            lightCubeShader.setMat4("projection", projection);
-            lightCubeShader.setMat4("view", view);
             glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, pointLightPos);
             model = glm::scale(model, glm::vec3(0.3f));
-            lightCubeShader.setMat4("model", model);
+            lightCubeShader.setMat4(modelHandle, model);
             lightCubeShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 0.8f));
             pointLightSphere.Draw(lightCubeShader);
         }
+
+        // Полупрозрачные объекты прямым освещением поверх готовой сцены, от дальних к ближним
+        if (!translucentDraws.empty()) {
+            std::sort(translucentDraws.begin(), translucentDraws.end(),
+                      [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+            lightingShader.use();
+            if (deferredShading) {
+                shadowMaps.bind(lightingShader, shadowsEnabled);
+                clusteredLights.bind(lightingShader, clusteredActive);
+            }
+            glEnable(GL_BLEND);
+            glDepthMask(GL_FALSE);
+            for (const auto& draw : translucentDraws) {
+                SceneObject& object = objects[draw.second];
+                lightingShader.setMat4(modelHandle, object.modelMatrix(totalTime));
+                lightingShader.setBool(useVertexColorHandle, object.useVertexColor);
+                lightingShader.setBool(useGradientHandle, object.useGradient);
+                lightingShader.setFloat(opacityHandle, object.opacity);
+                object.lodMesh(object.lod).Draw(lightingShader);
+            }
+            lightingShader.setFloat(opacityHandle, 1.0f);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+        }
         
         glError = glGetError();
         if (glError != GL_NO_ERROR && glError != GL_INVALID_OPERATION) {
             std::cerr << "OpenGL error during rendering: " << glError << std::endl;
         }
         
-        SDL_GL_SwapWindow(window);
+        if (benchmarkFrames > 0) {
+            glFlush();
+            if ((int)frameCount + 1 >= benchmarkFrames) running = false;
+        } else {
+            profiler.begin(swapScope);
+            SDL_GL_SwapWindow(window);
+            profiler.end(swapScope);
+        }
+        profiler.endFrame();
+
+        // Сводка в заголовке окна раз в секунду-другую
+        if (++frameCount % 120 == 0) {
+            SDL_SetWindowTitle(window, ("3D Сцена с разными фигурами | " + profiler.summary()).c_str());
+        }
+    }
+    
+    if (benchmarkFrames > 0) {
+        glFinish();
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - benchmarkStart).count();
+        std::cout << "Benchmark: " << frameCount << " frames in " << seconds << " s, "
+                  << frameCount / seconds << " FPS" << std::endl;
+        profiler.report(std::cout);
+
+        if (benchmarkChecksum) {
+            // FNV-1a по RGBA последнего кадра; сравнимо только между запусками на одном драйвере
+            std::vector<unsigned char> pixels(SCR_WIDTH * SCR_HEIGHT * 4);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, benchmarkFBO);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            uint64_t hash = 14695981039346656037ull;
+            for (unsigned char byte : pixels) hash = (hash ^ byte) * 1099511628211ull;
+            std::cout << "Frame checksum: " << std::hex << hash << std::dec << std::endl;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &benchmarkFBO);
+        glDeleteRenderbuffers(2, benchmarkRenderbuffers);
+        outputFramebuffer = 0;
     }
     
     std::cout << "Exiting..." << std::endl;
+
+    // GL-объекты сцены освобождаются, пока контекст ещё жив
+    textureLoader.shutdown();
+    sceneDraws.release();
+    instancedRenderer.clear();
+    objects.clear();
+    pointLightSphere = Mesh();
+    ResourceCache::instance().clear();
+    sceneUniforms.release();
+    shadowMaps.release();
+    clusteredLights.release();
+    gBuffer.release();
+    profiler.release();
+    marbleTexture.reset();
+    rasterProducer.reset();
+    dynamicUploads.release();
+    dynamicTexture.reset();
     
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);